@@ -0,0 +1,215 @@
+#include "animation.hpp"
+#include "batch.hpp"
+#include "interpreter.hpp"
+#include "renderer.hpp"
+#include "trace.hpp"
+#include "util.hpp"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <thread>
+#include <vector>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+// How long the display list is at the end of every frame. FRAME always ends one, even when nothing was drawn since
+// the last, so programs can hold a picture for a while. The segment count only ends one where FRAME didn't already.
+static vector<size_t> frame_ends(const Interpreter& ctx, size_t every) {
+    auto           segments = display_list_size(ctx.display_list);
+    vector<size_t> ends;
+    size_t         next = every;
+    for (auto marker : ctx.frames) {
+        for (; every > 0 && next < marker; next += every) ends.push_back(next);
+        if (every > 0 && next == marker) next += every;
+        ends.push_back(marker);
+    }
+    for (; every > 0 && next < segments; next += every) ends.push_back(next);
+    if (ends.empty() || ends.back() < segments) ends.push_back(segments);
+    return ends;
+}
+
+/*
+    Y4M, as 4:2:0 full range BT.601, the same YUV JPEG uses.
+*/
+struct Y4m_Stream {
+    FILE*           file;
+    size_t          width;
+    size_t          height;
+    vector<uint8_t> luma;
+    vector<uint8_t> blue; // Cb and Cr, one sample for every 2x2 block of pixels.
+    vector<uint8_t> red;
+};
+
+static bool y4m_open(Y4m_Stream& stream, const string& path, size_t width, size_t height, uint32_t fps) {
+    stream.file = path == "-" ? stdout : fopen(path.c_str(), "wb");
+    if (!stream.file) {
+        fprintf(stderr, "ERROR! Couldn't open '%s' for writing.\n", path.c_str());
+        return false;
+    }
+    stream.width  = width;
+    stream.height = height;
+    auto chroma   = ((width + 1) / 2) * ((height + 1) / 2);
+    stream.luma.assign(width * height, 0);
+    stream.blue.assign(chroma, 128);
+    stream.red.assign(chroma, 128);
+    fprintf(stream.file, "YUV4MPEG2 W%zu H%zu F%u:1 Ip A1:1 C420jpeg XYSCSS=420JPEG XCOLORRANGE=FULL\n", width,
+            height, fps);
+    return true;
+}
+
+// Converts the pixels in `rect`, widened to whole 2x2 blocks, into the stream's planes. Everything else in the planes
+// is still what the canvas held the last time it was converted.
+static void y4m_convert(Y4m_Stream& stream, Olivec_Canvas canvas, Pixel_Rect rect) {
+    auto chroma_width = (canvas.width + 1) / 2;
+    auto x_end = rect.x + rect.width, y_end = rect.y + rect.height;
+    for (size_t y = rect.y & ~1; y < y_end; y += 2) {
+        for (size_t x = rect.x & ~1; x < x_end; x += 2) {
+            int r = 0, g = 0, b = 0, n = 0;
+            for (size_t py = y; py < min(y + 2, canvas.height); py++) {
+                for (size_t px = x; px < min(x + 2, canvas.width); px++) {
+                    auto pixel = OLIVEC_PIXEL(canvas, px, py);
+                    int  pr = pixel & 0xff, pg = (pixel >> 8) & 0xff, pb = (pixel >> 16) & 0xff;
+                    stream.luma[py * canvas.width + px] = (77 * pr + 150 * pg + 29 * pb + 128) >> 8;
+                    r += pr, g += pg, b += pb, n++;
+                }
+            }
+            r = (r + n / 2) / n, g = (g + n / 2) / n, b = (b + n / 2) / n;
+            auto chroma         = y / 2 * chroma_width + x / 2;
+            stream.blue[chroma] = clamp(((-43 * r - 85 * g + 128 * b + 128) >> 8) + 128, 0, 255);
+            stream.red[chroma]  = clamp(((128 * r - 107 * g - 21 * b + 128) >> 8) + 128, 0, 255);
+        }
+    }
+}
+
+// A rectangle over two that holds no more pixels than the two do costs nothing more to encode, and saves an image and
+// its headers. Tiles next to each other that a stroke ran through often merge this way.
+static void merge_rects(vector<Pixel_Rect>& rects) {
+    for (bool merged = true; merged;) {
+        merged = false;
+        for (size_t i = 0; i < rects.size(); i++) {
+            for (size_t j = i + 1; j < rects.size(); j++) {
+                auto&  a = rects[i], &b = rects[j];
+                size_t x0 = min(a.x, b.x), x1 = max(a.x + a.width, b.x + b.width);
+                size_t y0 = min(a.y, b.y), y1 = max(a.y + a.height, b.y + b.height);
+                if ((x1 - x0) * (y1 - y0) > a.width * a.height + b.width * b.height) continue;
+                a        = {x0, y0, x1 - x0, y1 - y0};
+                rects[j] = rects.back();
+                rects.pop_back();
+                j      = i;
+                merged = true;
+            }
+        }
+    }
+}
+
+static bool y4m_write_frame(Y4m_Stream& stream) {
+    TRACE_SCOPE("encode");
+    fputs("FRAME\n", stream.file);
+    fwrite(stream.luma.data(), 1, stream.luma.size(), stream.file);
+    fwrite(stream.blue.data(), 1, stream.blue.size(), stream.file);
+    fwrite(stream.red.data(), 1, stream.red.size(), stream.file);
+    TRACE_COUNT(Bytes_Encoded, 6 + stream.luma.size() + stream.blue.size() + stream.red.size());
+    return !ferror(stream.file);
+}
+
+static bool y4m_close(Y4m_Stream& stream, const string& path) {
+    auto success = !ferror(stream.file);
+    success      = (stream.file == stdout ? fflush(stream.file) : fclose(stream.file)) == 0 && success;
+    if (!success) fprintf(stderr, "ERROR! Couldn't write '%s'.\n", path.c_str());
+    return success;
+}
+
+/*
+    The animation.
+*/
+// Runs the program once and plans its whole display list, then draws the plan a frame at a time onto one canvas that's
+// never cleared. Each frame only draws the lines finished since the last one, so the last frame is exactly what
+// rasterize draws, and only the rectangles their spans landed in are encoded or converted.
+int run_animation(const Animation_Options& options) {
+    Interpreter ctx;
+    reset_interpreter(ctx, options.width, options.height);
+    Render_Timing timing;
+    if (!execute_file(options.input.c_str(), ctx, timing)) return -1;
+    auto ends = frame_ends(ctx, options.every);
+
+    auto      y4m = options.format == Animation_Format::Y4m;
+    Y4m_Stream stream = {};
+    if (y4m) {
+        if (!y4m_open(stream, options.output, options.width, options.height, options.fps)) return -1;
+    } else {
+        error_code error;
+        fs::create_directories(options.output, error);
+        if (error) {
+            fprintf(stderr, "ERROR! Couldn't create the output directory '%s'.\n", options.output.c_str());
+            return -1;
+        }
+    }
+
+    Thread_Pool pool;
+    pool_start(pool, thread::hardware_concurrency());
+    auto encode = options.encode;
+    encode.pool = &pool;
+    encode.format = Image_Format::Png;
+
+    vector<uint32_t> pixels((size_t)options.width * options.height);
+    Olivec_Canvas    canvas = {.pixels = pixels.data(), .width = options.width, .height = options.height,
+                               .stride = options.width};
+    clear_canvas(canvas);
+
+    auto        plan_start = chrono::steady_clock::now();
+    Raster_Plan plan;
+    plan_raster(plan, canvas.width, canvas.height, ctx.display_list, 1);
+    timing.raster_ms += elapsed_ms(plan_start);
+
+    vector<Pixel_Rect> dirty;
+    size_t             line = 0, dirty_pixels = 0;
+    bool               success = true;
+    auto               start   = chrono::steady_clock::now();
+    for (size_t frame = 0; frame < ends.size() && success; frame++) {
+        TRACE_SCOPE("animation frame");
+        auto raster_start = chrono::steady_clock::now();
+        // A line merged from segments on both sides of the frame's end is drawn whole in the frame it finishes in, so
+        // it's only ever blended once.
+        size_t last = upper_bound(plan.ends.begin() + line, plan.ends.end(), ends[frame]) - plan.ends.begin();
+        draw_lines_over(canvas, plan, line, last, &pool, dirty);
+        line = last;
+        merge_rects(dirty);
+        // The first frame is the whole canvas. A frame that drew nothing still has to be a valid image.
+        if (frame == 0) dirty = {{0, 0, canvas.width, canvas.height}};
+        if (dirty.empty()) dirty = {{0, 0, 1, 1}};
+        for (auto& rect : dirty) dirty_pixels += rect.width * rect.height;
+        timing.raster_ms += elapsed_ms(raster_start);
+
+        auto encode_start = chrono::steady_clock::now();
+        if (y4m) {
+            for (auto& rect : dirty) y4m_convert(stream, canvas, rect);
+            success = y4m_write_frame(stream);
+        } else {
+            for (size_t i = 0; i < dirty.size() && success; i++) {
+                auto& rect = dirty[i];
+                char  name[64];
+                snprintf(name, sizeof(name), "frame_%05zu_%03zu.png", frame, i);
+                auto region   = canvas;
+                region.pixels = &OLIVEC_PIXEL(canvas, rect.x, rect.y);
+                region.width  = rect.width;
+                region.height = rect.height;
+                success = write_image_at((fs::path(options.output) / name).c_str(), region, rect.x, rect.y, encode);
+            }
+        }
+        timing.encode_ms += elapsed_ms(encode_start);
+    }
+    auto wall_ms = elapsed_ms(start);
+    pool_stop(pool);
+    if (y4m) success = y4m_close(stream, options.output) && success;
+    if (!success) return -1;
+
+    // Y4M might be going to stdout, so the summary goes to stderr.
+    fprintf(stderr,
+            "%zu frames from %zu segments (%zu FRAME markers): %.1f%% of the canvas redrawn per frame, compile %.3f "
+            "ms, execute %.3f ms, raster %.3f ms, encode %.3f ms, %.1f frames/s\n",
+            ends.size(), display_list_size(ctx.display_list), ctx.frames.size(),
+            100.0 * dirty_pixels / ((double)ends.size() * canvas.width * canvas.height), timing.compile_ms,
+            timing.execute_ms, timing.raster_ms, timing.encode_ms, ends.size() / (wall_ms / 1000.0));
+    return 0;
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include "encoder.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// A PNG sequence only holds what changed in each frame: frame_00000_000.png is the whole canvas, and every frame after
+// it is just the rectangles that changed since the one before, frame_NNNNN_000.png and on, each positioned with an
+// oFFs chunk. Y4M can't hold partial frames, so every frame goes out whole, but only the changed rectangles are
+// converted to YUV again.
+enum class Animation_Format { Png_Sequence, Y4m };
+
+struct Animation_Options {
+    std::string      input;
+    std::string      output; // The directory for a PNG sequence, or the Y4M file. "-" streams Y4M to stdout.
+    Animation_Format format;
+    // A frame ends every this many segments, on top of at every FRAME the program runs. 0 only ends them at FRAME.
+    size_t           every;
+    uint32_t         fps;
+    uint32_t         width;
+    uint32_t         height;
+    Encode_Options   encode;
+};
+
+int run_animation(const Animation_Options& options);
@@ -0,0 +1,193 @@
+#include "batch.hpp"
+#include "kernels.hpp"
+#include "thread_pool.hpp"
+#include "trace.hpp"
+#include "util.hpp"
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <set>
+#include <vector>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+// Compiles the program at `path` and runs it on `ctx`, leaving what it drew in ctx.display_list.
+bool execute_file(const char* path, Interpreter& ctx, Render_Timing& timing) {
+    TRACE_SCOPE("job");
+    timing = {0, 0, 0, 0};
+
+    auto start = chrono::steady_clock::now();
+    auto file  = map_file(path);
+    if (!file) {
+        fprintf(error_output, "ERROR! Couldn't open '%s'.\n", path);
+        return false;
+    }
+    auto program = compile(file->contents());
+    unmap_file(*file);
+    timing.compile_ms = elapsed_ms(start);
+    if (!program) return false;
+
+    start        = chrono::steady_clock::now();
+    auto success = run(ctx, *program);
+    timing.execute_ms = elapsed_ms(start);
+    return success;
+}
+
+// Rasterizes what `ctx` drew at `scale` into `pixels`, spreading the tiles over `pool` if there is one, then encodes
+// the image to `output` if one is given.
+bool render_image(const Interpreter& ctx, float scale, const char* output, const Encode_Options& encode,
+                  vector<uint32_t>& pixels, Thread_Pool* pool, Render_Timing& timing) {
+    auto start  = chrono::steady_clock::now();
+    auto width  = max<size_t>(1, lroundf(ctx.width * scale));
+    auto height = max<size_t>(1, lroundf(ctx.height * scale));
+    pixels.resize(width * height);
+    Olivec_Canvas canvas = {.pixels = pixels.data(), .width = width, .height = height, .stride = width};
+    clear_canvas(canvas);
+    rasterize(canvas, ctx.display_list, scale, pool);
+    timing.raster_ms += elapsed_ms(start);
+
+    if (output) {
+        start = chrono::steady_clock::now();
+        if (!write_image(output, canvas, encode)) return false;
+        timing.encode_ms += elapsed_ms(start);
+    }
+    return true;
+}
+
+// A directory contributes every .lg file in it, anything else is read as a manifest of paths relative to itself.
+static bool collect_inputs(const string& input, vector<string>& inputs) {
+    error_code error;
+    if (fs::is_directory(input, error)) {
+        for (auto& entry : fs::directory_iterator(input, error)) {
+            if (entry.path().extension() == ".lg") inputs.push_back(entry.path().string());
+        }
+        sort(inputs.begin(), inputs.end());
+        return !error;
+    }
+
+    ifstream manifest(input);
+    if (!manifest) return false;
+    auto   base = fs::path(input).parent_path();
+    string line;
+    while (getline(manifest, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty() || line[0] == '#') continue;
+        inputs.push_back(fs::path(line).is_absolute() ? line : (base / line).string());
+    }
+    return true;
+}
+
+// Outputs are named after their program's stem. Programs from different directories can share one, so those get their
+// position in the list added, and a few more times if that happens to be some other program's name too.
+static vector<string> output_names(const vector<string>& inputs) {
+    vector<string>      stems;
+    map<string, size_t> uses;
+    for (auto& input : inputs) {
+        stems.push_back(fs::path(input).stem().string());
+        uses[stems.back()]++;
+    }
+    set<string>    taken(stems.begin(), stems.end());
+    vector<string> names;
+    for (size_t i = 0; i < inputs.size(); i++) {
+        auto name = stems[i];
+        if (uses[name] > 1) {
+            auto index = to_string(i).insert(0, "-");
+            name += index;
+            while (!taken.insert(name).second) name += index;
+        }
+        names.push_back(name);
+    }
+    return names;
+}
+
+struct Job_Result {
+    bool          ok;
+    string        error; // What the job reported when it failed, printed after the table.
+    Render_Timing timing;
+};
+
+int run_batch(const Batch_Options& options) {
+    vector<string> inputs;
+    if (!collect_inputs(options.input, inputs)) {
+        fprintf(stderr, "ERROR! Couldn't read the programs to render from '%s'.\n", options.input.c_str());
+        return -1;
+    }
+    error_code error;
+    fs::create_directories(options.output_dir, error);
+    if (error) {
+        fprintf(stderr, "ERROR! Couldn't create the output directory '%s'.\n", options.output_dir.c_str());
+        return -1;
+    }
+
+    auto               names = output_names(inputs);
+    vector<Job_Result> results(inputs.size());
+    Thread_Pool        pool;
+    Task_Group         group;
+    auto               encode = options.encode;
+    encode.pool               = &pool;
+    pool_start(pool, options.jobs);
+
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < inputs.size(); i++) {
+        pool_submit(pool, group, [&, i] {
+            // Each worker keeps its canvas between jobs so we only pay for the page faults once.
+            thread_local vector<uint32_t> pixels;
+            auto&                         result = results[i];
+            // Jobs run side by side, so their errors are kept until they can be printed with their file's name.
+            Error_Capture capture;
+            begin_error_capture(capture);
+
+            Interpreter ctx;
+            reset_interpreter(ctx, options.width, options.height);
+            result.ok = execute_file(inputs[i].c_str(), ctx, result.timing);
+
+            auto stem = (fs::path(options.output_dir) / names[i]).string();
+            for (auto scale : options.scales) {
+                if (!result.ok) break;
+                auto extension  = image_extension(encode.format);
+                char suffix[32] = "";
+                if (scale != 1) snprintf(suffix, sizeof(suffix), "@%gx", scale);
+                auto output = stem + suffix + extension;
+                result.ok   = render_image(ctx, scale, output.c_str(), encode, pixels, &pool, result.timing);
+            }
+            result.error = end_error_capture(capture);
+        });
+    }
+    pool_wait(pool, group);
+    auto wall_ms = elapsed_ms(start);
+    pool_stop(pool);
+
+    size_t failed = 0;
+    double busy_ms = 0;
+    printf("%-40s %8s %12s %12s %12s %12s\n", "program", "status", "compile ms", "execute ms", "raster ms",
+           "encode ms");
+    for (size_t i = 0; i < inputs.size(); i++) {
+        auto& result = results[i];
+        failed += !result.ok;
+        auto& timing = result.timing;
+        busy_ms += timing.compile_ms + timing.execute_ms + timing.raster_ms + timing.encode_ms;
+        printf("%-40s %8s %12.3f %12.3f %12.3f %12.3f\n", fs::path(inputs[i]).filename().c_str(),
+               result.ok ? "ok" : "FAILED", timing.compile_ms, timing.execute_ms, timing.raster_ms, timing.encode_ms);
+    }
+    if (failed > 0) {
+        fflush(stdout);
+        fprintf(stderr, "\n");
+        for (size_t i = 0; i < inputs.size(); i++) {
+            if (results[i].ok) continue;
+            string_view error = results[i].error;
+            if (error.empty()) error = "FAILED";
+            for (size_t start = 0, end; start < error.size(); start = end + 1) {
+                end = min(error.find('\n', start), error.size());
+                fprintf(stderr, "%s: %.*s\n", inputs[i].c_str(), (int)(end - start), error.data() + start);
+            }
+        }
+    }
+    printf("\n%zu programs (%zu failed) in %.1f ms on %zu threads: %.1f programs/s, %.2fx parallel speedup, "
+           "%s spans\n",
+           inputs.size(), failed, wall_ms, options.jobs, inputs.size() / (wall_ms / 1000.0),
+           wall_ms > 0 ? busy_ms / wall_ms : 0.0, span_kernel_isa());
+    return failed ? -1 : 0;
+}
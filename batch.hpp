@@ -0,0 +1,31 @@
+#pragma once
+#include "encoder.hpp"
+#include "interpreter.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct Render_Timing {
+    double compile_ms;
+    double execute_ms;
+    double raster_ms;
+    double encode_ms;
+};
+
+struct Batch_Options {
+    std::string input;      // A directory of .lg files, or a manifest listing one path per line.
+    std::string output_dir; // Every program's image is written here as <name>.png, or whichever format is picked.
+    size_t      jobs;
+    uint32_t    width;
+    uint32_t    height;
+    // Every program runs once and is rasterized at each of these scales. Scales other than 1 are saved as
+    // <name>@<scale>x.png.
+    std::vector<float> scales;
+    Encode_Options     encode;
+};
+
+bool execute_file(const char* path, Interpreter& ctx, Render_Timing& timing);
+bool render_image(const Interpreter& ctx, float scale, const char* output, const Encode_Options& encode,
+                  std::vector<uint32_t>& pixels, Thread_Pool* pool, Render_Timing& timing);
+int  run_batch(const Batch_Options& options);
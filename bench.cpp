@@ -0,0 +1,303 @@
+#include "bench.hpp"
+#include "batch.hpp"
+#include "compiler.hpp"
+#include "interpreter.hpp"
+#include "kernels.hpp"
+#include "lexer.hpp"
+#include "thread_pool.hpp"
+#include "util.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <thread>
+#include <vector>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+// Every program is timed in these phases, in the order they run. Parsing pulls its own tokens from the lexer, so the
+// parse time includes lexing again, lex on its own is there to show how much of it that is.
+enum class Phase { Lex, Parse, Compile, Execute, Raster, Encode };
+constexpr const char* PHASE_NAMES[] = {"lex", "parse", "compile", "execute", "raster", "encode"};
+constexpr size_t      PHASE_COUNT   = size(PHASE_NAMES);
+
+struct Bench_Program {
+    string         name;
+    string         source;
+    bool           ok;
+    string         error; // What it reported when it failed, if anything.
+    size_t         tokens;
+    size_t         instructions;
+    size_t         segments;
+    vector<double> samples[PHASE_COUNT]; // Milliseconds, one per timed repetition.
+};
+
+struct Summary {
+    double min, median, p90, p99, max, mean;
+};
+
+/*
+    Stress programs, each one much harder on one part of the pipeline than any of the examples.
+*/
+// 200 levels of IF inside a loop, for the parser's block stack and the interpreter's jumps.
+static string stress_deep_nesting() {
+    string source = "PENDOWN\nMAKE \"N \"0\nWHILE LT :N \"2000 [\n";
+    for (int depth = 0; depth < 200; depth++) source += depth % 2 ? "IF LT :N \"100000 [\n" : "IF GT :N \"-1 [\n";
+    source += "FORWARD \"1\nTURN \"7\n";
+    for (int depth = 0; depth < 200; depth++) source += "]\n";
+    return source + "ADDASSIGN \"N \"1\n]\n";
+}
+
+// A million iterations the interpreter has to step through, the distance comes from a variable so the loop can't be
+// run in closed form.
+static string stress_million_loop() {
+    return "PENDOWN\nMAKE \"I \"0\nMAKE \"STEP \"2\nWHILE LT :I \"1000000 [\n"
+           "FORWARD :STEP\nTURN \"89\nADDASSIGN \"I \"1\n]\n";
+}
+
+// The same million iterations with constants, which the optimizer turns into a Motion_Loop.
+static string stress_million_motion_loop() {
+    return "PENDOWN\nMAKE \"I \"0\nWHILE LT :I \"1000000 [\nFORWARD \"2\nTURN \"89\nADDASSIGN \"I \"1\n]\n";
+}
+
+static string stress_many_procedures() {
+    string source;
+    for (int i = 0; i < 2000; i++) {
+        source += "TO P" + to_string(i) + " \"A\nFORWARD :A\nTURN \"" + to_string(i % 360) + "\nEND\n";
+    }
+    source += "PENDOWN\n";
+    for (int i = 0; i < 2000; i++) source += "P" + to_string(i) + " \"" + to_string(i % 50) + "\n";
+    return source;
+}
+
+static string stress_straight_line() {
+    string source = "PENDOWN\nMAKE \"V \"0\n";
+    for (int i = 0; i < 200000; i++) {
+        switch (i % 3) {
+            case 0:
+                source += "FORWARD \"" + to_string(i % 40) + "\n";
+                break;
+            case 1:
+                source += "TURN \"" + to_string(i % 170) + "\n";
+                break;
+            default:
+                source += "MAKE \"V + :V \"1\n";
+                break;
+        }
+    }
+    return source;
+}
+
+/*
+    Measuring.
+*/
+static void add_program(vector<Bench_Program>& programs, string name, string source) {
+    auto& program  = programs.emplace_back();
+    program.name   = std::move(name);
+    program.source = std::move(source);
+    program.ok     = true;
+}
+
+// A file that can't be read is measured as a failed program, the rest of the directory is still worth timing.
+static void add_program_file(vector<Bench_Program>& programs, const fs::path& path) {
+    auto file = map_file(path.c_str());
+    if (!file) {
+        auto& program = programs.emplace_back();
+        program.name  = path.filename().string();
+        program.ok    = false;
+        program.error = "ERROR! Couldn't open '" + path.string() + "'.";
+        return;
+    }
+    add_program(programs, path.filename().string(), string(file->contents()));
+    unmap_file(*file);
+}
+
+// Runs every phase of `program` once. Unless it's a warmup run, how long each phase took is added to its samples.
+static bool measure(Bench_Program& program, const Bench_Options& options, const Encode_Options& encode,
+                    const string& image, vector<uint32_t>& pixels, Thread_Pool& pool, bool warmup) {
+    double times[PHASE_COUNT];
+
+    auto   start  = chrono::steady_clock::now();
+    auto   lexer  = make_lexer(program.source);
+    size_t tokens = 0;
+    while (next_token(lexer).type != Token_Type::EndOfFile) tokens++;
+    times[(size_t)Phase::Lex] = elapsed_ms(start);
+
+    start    = chrono::steady_clock::now();
+    auto ast = parse_program(program.source);
+    times[(size_t)Phase::Parse] = elapsed_ms(start);
+    if (!ast) return false;
+
+    start = chrono::steady_clock::now();
+    optimize(*ast);
+    auto code = generate_bytecode(*ast);
+    times[(size_t)Phase::Compile] = elapsed_ms(start);
+
+    Interpreter ctx;
+    reset_interpreter(ctx, options.width, options.height);
+    start   = chrono::steady_clock::now();
+    auto ok = run(ctx, code);
+    times[(size_t)Phase::Execute] = elapsed_ms(start);
+    if (!ok) return false;
+
+    Render_Timing timing = {0, 0, 0, 0};
+    if (!render_image(ctx, 1, image.c_str(), encode, pixels, &pool, timing)) return false;
+    times[(size_t)Phase::Raster] = timing.raster_ms;
+    times[(size_t)Phase::Encode] = timing.encode_ms;
+
+    if (warmup) return true;
+    program.tokens       = tokens;
+    program.instructions = code.code.size();
+    program.segments     = display_list_size(ctx.display_list);
+    for (size_t phase = 0; phase < PHASE_COUNT; phase++) program.samples[phase].push_back(times[phase]);
+    return true;
+}
+
+// Percentiles are nearest rank, so with few repetitions the high ones are just the slowest run.
+static Summary summarize(vector<double> samples) {
+    if (samples.empty()) return {0, 0, 0, 0, 0, 0};
+    sort(samples.begin(), samples.end());
+    auto percentile = [&](double p) {
+        auto rank = (size_t)ceil(p / 100 * samples.size());
+        return samples[clamp<size_t>(rank, 1, samples.size()) - 1];
+    };
+    double sum = 0;
+    for (auto sample : samples) sum += sample;
+    return {samples.front(), percentile(50), percentile(90), percentile(99), samples.back(), sum / samples.size()};
+}
+
+static void write_json_string(FILE* out, const string& text) {
+    fputc('"', out);
+    for (unsigned char c : text) {
+        if (c == '"' || c == '\\') {
+            fputc('\\', out);
+            fputc(c, out);
+        } else if (c == '\n') {
+            fputs("\\n", out);
+        } else if (c < 0x20) {
+            // JSON allows no raw control characters in a string, and names or error text can have any of them.
+            fprintf(out, "\\u%04x", c);
+        } else {
+            fputc(c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+static bool write_json(const Bench_Options& options, const vector<Bench_Program>& programs, size_t threads) {
+    auto out = fopen(options.output.c_str(), "w");
+    if (!out) return false;
+    fprintf(out, "{\n  \"config\": ");
+    write_json_string(out, BUILD_CONFIG);
+    fprintf(out, ",\n  \"compiler\": ");
+    write_json_string(out, __VERSION__);
+    fprintf(out, ",\n  \"span_isa\": \"%s\",\n  \"threads\": %zu,\n  \"warmup\": %zu,\n  \"repetitions\": %zu,\n",
+            span_kernel_isa(), threads, options.warmup, options.repetitions);
+    fprintf(out, "  \"width\": %u,\n  \"height\": %u,\n  \"programs\": [", options.width, options.height);
+    for (size_t i = 0; i < programs.size(); i++) {
+        auto& program = programs[i];
+        fprintf(out, "%s\n    {\"name\": ", i ? "," : "");
+        write_json_string(out, program.name);
+        fprintf(out, ", \"ok\": %s", program.ok ? "true" : "false");
+        if (!program.ok) {
+            fprintf(out, ", \"error\": ");
+            write_json_string(out, program.error);
+            fprintf(out, "}");
+            continue;
+        }
+        fprintf(out, ", \"tokens\": %zu, \"instructions\": %zu, \"segments\": %zu, \"phases\": {", program.tokens,
+                program.instructions, program.segments);
+        for (size_t phase = 0; phase < PHASE_COUNT; phase++) {
+            auto summary = summarize(program.samples[phase]);
+            fprintf(out,
+                    "%s\n      \"%s\": {\"min\": %.6f, \"median\": %.6f, \"p90\": %.6f, \"p99\": %.6f, \"max\": %.6f, "
+                    "\"mean\": %.6f}",
+                    phase ? "," : "", PHASE_NAMES[phase], summary.min, summary.median, summary.p90, summary.p99,
+                    summary.max, summary.mean);
+        }
+        fprintf(out, "\n    }}");
+    }
+    fprintf(out, "\n  ]\n}\n");
+    return fclose(out) == 0;
+}
+
+// Times every program in the input directory, and the stress programs, phase by phase. Prints the medians and
+// writes every summary to options.output as JSON.
+int run_bench(const Bench_Options& options) {
+    vector<Bench_Program> programs;
+    error_code            error;
+    for (auto& entry : fs::directory_iterator(options.input, error)) {
+        if (entry.path().extension() != ".lg") continue;
+        add_program_file(programs, entry.path());
+    }
+    if (error) {
+        fprintf(stderr, "ERROR! Couldn't read the programs to measure from '%s'.\n", options.input.c_str());
+        return -1;
+    }
+    sort(programs.begin(), programs.end(), [](auto& a, auto& b) { return a.name < b.name; });
+    if (options.stress) {
+        add_program(programs, "stress/deep_nesting", stress_deep_nesting());
+        add_program(programs, "stress/million_loop", stress_million_loop());
+        add_program(programs, "stress/million_motion_loop", stress_million_motion_loop());
+        add_program(programs, "stress/many_procedures", stress_many_procedures());
+        add_program(programs, "stress/straight_line", stress_straight_line());
+    }
+
+    auto        threads = max(1u, thread::hardware_concurrency());
+    Thread_Pool pool;
+    pool_start(pool, threads);
+    auto encode  = options.encode;
+    encode.pool  = &pool;
+    auto image   = (fs::temp_directory_path() / (string("logo_bench") + image_extension(encode.format))).string();
+    vector<uint32_t> pixels;
+
+    printf("%-36s", "median ms");
+    for (auto name : PHASE_NAMES) printf(" %10s", name);
+    printf(" %10s\n", "total");
+    size_t failed = 0;
+    for (auto& program : programs) {
+        // The program's errors are kept until the table is done, so they don't end up in the middle of it.
+        if (program.ok) {
+            Error_Capture capture;
+            begin_error_capture(capture);
+            for (size_t run = 0; run < options.warmup + options.repetitions && program.ok; run++) {
+                program.ok = measure(program, options, encode, image, pixels, pool, run < options.warmup);
+            }
+            program.error = end_error_capture(capture);
+        }
+        failed += !program.ok;
+
+        printf("%-36s", program.name.c_str());
+        if (!program.ok) {
+            printf(" %10s\n", "error");
+            continue;
+        }
+        double total = 0;
+        for (auto& samples : program.samples) {
+            auto median = summarize(samples).median;
+            total += median;
+            printf(" %10.3f", median);
+        }
+        printf(" %10.3f\n", total);
+    }
+    pool_stop(pool);
+    fs::remove(image, error);
+    if (failed > 0) {
+        fflush(stdout);
+        fprintf(stderr, "\n%zu programs failed:\n", failed);
+        for (auto& program : programs) {
+            if (program.ok) continue;
+            fprintf(stderr, "%s: %s\n", program.name.c_str(), program.error.empty() ? "failed" : program.error.c_str());
+        }
+    }
+
+    if (!write_json(options, programs, threads)) {
+        fprintf(stderr, "ERROR! Couldn't write the results to '%s'.\n", options.output.c_str());
+        return -1;
+    }
+    printf("\n%zu programs, %zu warmup and %zu timed runs each, %s build, %s spans. Results in '%s'.\n",
+           programs.size(), options.warmup, options.repetitions, BUILD_CONFIG, span_kernel_isa(),
+           options.output.c_str());
+    return 0;
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include "encoder.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Which build the numbers came from, so results from different configurations can be told apart. build.sh sets it.
+#ifndef BUILD_CONFIG
+#define BUILD_CONFIG "unknown"
+#endif
+
+struct Bench_Options {
+    std::string    input;  // A directory of .lg programs to measure.
+    std::string    output; // Where the JSON results go.
+    size_t         warmup; // Untimed runs of every program before the timed ones.
+    size_t         repetitions;
+    bool           stress; // Also measure the generated stress programs.
+    uint32_t       width;
+    uint32_t       height;
+    Encode_Options encode;
+};
+
+int run_bench(const Bench_Options& options);
@@ -1,44 +1,115 @@
 #!/bin/bash
 set -e
 
-#echo "" 
+# Usage: ./build.sh [config] [target]
+#   config: debug (default), release (-O2), o3 (-O3 -march=native), lto (o3 plus ThinLTO), or pgo (lto trained on the
+#           benchmark's own profile).
+#   target: run (default) runs the app once, bench runs the benchmark into <build dir>/bench.json, none just builds.
+# With TRACE=1 the instrumentation in trace.hpp is compiled in and the build goes to its own directory, so --trace
+# works and traced objects never mix with untraced ones.
+CONFIG=${1:-debug}
+TARGET=${2:-run}
+TRACE=${TRACE:-0}
+
 # Config
-CXX=clang++
-CXXFLAGS="-Wall -Wextra -O0 -g -fno-exceptions -fno-rtti -fdiagnostics-color=always -std=c++23"
+CXX=${CXX:-clang++}
+CXXFLAGS="-Wall -Wextra -fno-exceptions -fno-rtti -fdiagnostics-color=always -std=c++23"
 # LDFLAGS="-lraylib -lm -ldl -lpthread -lGL -lX11"
+LDFLAGS="-pthread -lz"
 SRC_DIR=./
-BUILD_DIR=build
 OUT=app
-OUT_PATH="$BUILD_DIR/$OUT"
 
-mkdir -p "$BUILD_DIR"
+case "$CONFIG" in
+    debug)
+        OPT_FLAGS="-O0 -g"
+        BUILD_DIR=build
+        ;;
+    release)
+        OPT_FLAGS="-O2 -g"
+        BUILD_DIR=build/release
+        ;;
+    o3)
+        OPT_FLAGS="-O3 -march=native -g"
+        BUILD_DIR=build/o3
+        ;;
+    lto | pgo)
+        OPT_FLAGS="-O3 -march=native -g -flto=thin"
+        LDFLAGS="$LDFLAGS -flto=thin"
+        BUILD_DIR=build/$CONFIG
+        ;;
+    *)
+        echo "Unknown config '$CONFIG', expected debug, release, o3, lto or pgo."
+        exit 1
+        ;;
+esac
+
+BUILD_NAME=$CONFIG
+if [ "$TRACE" = 1 ]; then
+    CXXFLAGS="$CXXFLAGS -DLOGO_TRACE=1"
+    BUILD_NAME=$CONFIG+trace
+    BUILD_DIR=build/$CONFIG-trace
+fi
+CXXFLAGS="$CXXFLAGS -DBUILD_CONFIG=\"$BUILD_NAME\""
+
+# Compiles every changed .cpp file in $1 with the flags in $2 and links them into $1/$OUT with the extra flags in $3.
+build() {
+    local dir=$1 flags=$2 link_flags=$3
+    local objects=() recompiled=0
+    mkdir -p "$dir"
 
-# Track object files
-OBJECTS=()
+    for src in $(find "$SRC_DIR" -name '*.cpp' -not -path "./build/*"); do
+        obj="$dir/$(basename "${src%.cpp}.o")"
+        objects+=("$obj")
 
-# Compile changed .cpp files
-recompiled=0
-for src in $(find "$SRC_DIR" -name '*.cpp'); do
-    obj="$BUILD_DIR/$(basename "${src%.cpp}.o")"
-    OBJECTS+=("$obj")
+        # Recompile if .o doesn't exist or .cpp is newer
+        if [ ! -f "$obj" ] || [ "$src" -nt "$obj" ]; then
+            echo "Compiling: $src"
+            $CXX $CXXFLAGS $flags -c "$src" -o "$obj"
+            recompiled=1
+        fi
+    done
 
-    # Recompile if .o doesn't exist or .cpp is newer
-    if [ ! -f "$obj" ] || [ "$src" -nt "$obj" ]; then
-        echo "Compiling: $src"
-        $CXX $CXXFLAGS -c "$src" -o "$obj"
-        recompiled=1
+    # Relink if any object was recompiled or binary doesn't exist
+    if [ "$recompiled" -eq 1 ] || [ ! -f "$dir/$OUT" ]; then
+        echo "Linking: $dir/$OUT"
+        $CXX "${objects[@]}" $LDFLAGS $link_flags -o "$dir/$OUT"
+    else
+        echo "Nothing changed, skipping link."
     fi
-done
+}
 
-# Relink if any object was recompiled or binary doesn't exist
-if [ "$recompiled" -eq 1 ] || [ ! -f "$OUT_PATH" ]; then
-    echo "Linking: $OUT"
-    $CXX "${OBJECTS[@]}" -o "$OUT_PATH"
+if [ "$CONFIG" = pgo ]; then
+    # Train an instrumented build on the benchmark, then build again with what it recorded. The profile changes
+    # every time, so the final build always starts from scratch.
+    PROFILE_DIR="$BUILD_DIR/profile"
+    build "$BUILD_DIR/instrumented" "$OPT_FLAGS -fprofile-instr-generate" "-fprofile-instr-generate"
+    rm -rf "$PROFILE_DIR" && mkdir -p "$PROFILE_DIR"
+    echo "Training: $BUILD_DIR/instrumented/$OUT"
+    LLVM_PROFILE_FILE="$PROFILE_DIR/%p.profraw" "$BUILD_DIR/instrumented/$OUT" --bench logo_examples \
+        --out "$PROFILE_DIR/bench.json" --warmup 0 --reps 1 > /dev/null
+    llvm-profdata merge -o "$PROFILE_DIR/app.profdata" "$PROFILE_DIR"/*.profraw
+    rm -f "$BUILD_DIR"/*.o
+    build "$BUILD_DIR" "$OPT_FLAGS -fprofile-instr-use=$PROFILE_DIR/app.profdata" ""
 else
-    echo "Nothing changed, skipping link."
+    build "$BUILD_DIR" "$OPT_FLAGS" ""
 fi
-
+OUT_PATH="$BUILD_DIR/$OUT"
 echo "Build done: $OUT_PATH"
-echo "Running program..."
-echo ""
-"$OUT_PATH"
+
+case "$TARGET" in
+    run)
+        echo "Running program..."
+        echo ""
+        "$OUT_PATH"
+        ;;
+    bench)
+        echo "Benchmarking..."
+        echo ""
+        "$OUT_PATH" --bench logo_examples --out "$BUILD_DIR/bench.json"
+        ;;
+    none) ;;
+    *)
+        echo "Unknown target '$TARGET', expected run, bench or none."
+        exit 1
+        ;;
+esac
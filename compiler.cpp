@@ -0,0 +1,911 @@
+#include "compiler.hpp"
+#include "trace.hpp"
+#include "util.hpp"
+#include <bit>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <unordered_map>
+
+using namespace std;
+
+/*
+    Parsing: source text -> AST.
+*/
+enum class Block_Kind { If, While, Procedure };
+
+struct Open_Block {
+    Block_Kind kind;
+    uint32_t   line;
+    Stmt_List* parent; // Where statements go again once the block is closed.
+};
+
+// Open addressing hash set of every name and word seen so far, the table itself lives in the arena too.
+struct String_Table {
+    string_view* slots;
+    uint32_t     capacity;
+    uint32_t     count;
+};
+
+// Tokens are pulled from the lexer one at a time and never stored, the tree goes into the AST's arena, so parsing
+// only mallocs when the arena needs another chunk.
+struct Parser {
+    Ast                 ast;
+    Lexer               lexer;
+    Token               token;   // The token currently being looked at.
+    Stmt_List*          current; // The statement list being appended to.
+    vector<Open_Block>  blocks;
+    String_Table        strings;
+    vector<string_view> params; // Scratch space for a TO line's parameters.
+};
+
+constexpr size_t AST_CHUNK_SIZE = 64 * 1024;
+
+static uint32_t hash_string(string_view text) {
+    uint32_t hash = 2166136261u;
+    for (auto c : text) hash = (hash ^ (uint8_t)c) * 16777619u;
+    return hash;
+}
+
+// Returns the arena's copy of `text`, making one the first time it's seen.
+static string_view intern(Parser& p, string_view text) {
+    auto& table = p.strings;
+    if ((table.count + 1) * 2 > table.capacity) {
+        auto old       = table;
+        table.capacity = old.capacity ? old.capacity * 2 : 256;
+        table.slots    = alloc<string_view>(p.ast.arena.get(), table.capacity);
+        for (uint32_t i = 0; i < old.capacity; i++) {
+            if (!old.slots[i].data()) continue;
+            auto slot = hash_string(old.slots[i]) & (table.capacity - 1);
+            while (table.slots[slot].data()) slot = (slot + 1) & (table.capacity - 1);
+            table.slots[slot] = old.slots[i];
+        }
+    }
+
+    auto slot = hash_string(text) & (table.capacity - 1);
+    for (; table.slots[slot].data(); slot = (slot + 1) & (table.capacity - 1)) {
+        if (table.slots[slot] == text) return table.slots[slot];
+    }
+    // Always at least one byte, so even the empty word gets a non-null pointer that marks its slot as taken.
+    auto copy = alloc<char>(p.ast.arena.get(), text.size() + 1);
+    memcpy(copy, text.data(), text.size());
+    table.slots[slot] = string_view(copy, text.size());
+    table.count++;
+    return table.slots[slot];
+}
+
+Statement_Type parse_statement_type(Token_Type token) {
+    using enum Token_Type;
+    switch (token) {
+        case PENUP:
+        case PENDOWN:
+        case FORWARD:
+        case BACK:
+        case LEFT:
+        case RIGHT:
+        case TURN:
+        case SETHEADING:
+        case SETX:
+        case SETY:
+            return Statement_Type::Pen_Movement;
+        case SETPENCOLOR:
+        case SETPENSIZE:
+            return Statement_Type::Pen_Color;
+        case ADDASSIGN:
+            return Statement_Type::Add_Assign;
+        case Fn:
+            return Statement_Type::Function_Decleration;
+        case MAKE:
+            return Statement_Type::Variable_Decleration;
+        case IF:
+            return Statement_Type::If;
+        case WHILE:
+            return Statement_Type::While;
+        case FRAME:
+            return Statement_Type::Frame;
+        case Identifier:
+            return Statement_Type::Procedure_Call;
+        case Comment:
+            return Statement_Type::Comment;
+        case InvalidToken:
+            return Statement_Type::Erroneous;
+        default:
+            return Statement_Type::Erroneous;
+    }
+}
+
+// Parses the text of a "word into a typed value. All logo values are strings, but the ones that look like
+// numbers or booleans are stored as such so we don't have to re-parse them while executing.
+static Logo_Value parse_value(Parser& p, string_view text) {
+    if (text == "TRUE") return true;
+    if (text == "FALSE") return false;
+    float number;
+    auto [end, error] = from_chars(text.data(), text.data() + text.size(), number);
+    if (!text.empty() && error == errc() && end == text.data() + text.size()) return number;
+    return intern(p, text);
+}
+
+static bool is_binary_operator(Token_Type token) {
+    using enum Token_Type;
+    switch (token) {
+        case EQ:
+        case NE:
+        case GT:
+        case LT:
+        case AND:
+        case OR:
+        case Plus:
+        case Minus:
+        case Star:
+        case Slash:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static void advance(Parser& p) {
+    p.token = next_token(p.lexer);
+    TRACE_COUNT(Tokens, 1);
+}
+
+// A statement runs until the end of its line, or until the ] closing the block it is in.
+static bool at_statement_end(const Parser& p) {
+    auto type = p.token.type;
+    return type == Token_Type::Newline || type == Token_Type::EndOfFile || type == Token_Type::R_Bracket;
+}
+
+// Nodes come out of the arena zeroed, so only the fields that aren't zero by default are set here.
+static Expr* new_expr(Parser& p, Expr_Kind kind, Token_Type op) {
+    auto expr  = alloc<Expr>(p.ast.arena.get());
+    expr->kind = kind;
+    expr->op   = op;
+    expr->line = p.token.line;
+    return expr;
+}
+
+static Stmt* new_stmt(Parser& p, Statement_Type type, Token_Type command) {
+    auto stmt     = alloc<Stmt>(p.ast.arena.get());
+    stmt->type    = type;
+    stmt->command = command;
+    stmt->line    = p.token.line;
+    return stmt;
+}
+
+static void append(Stmt_List& list, Stmt* stmt) {
+    if (list.last) {
+        list.last->next = stmt;
+    } else {
+        list.first = stmt;
+    }
+    list.last = stmt;
+}
+
+// Expressions are prefix (polish) notation, so every operator is directly followed by its operands.
+static Expr* parse_expression(Parser& p) {
+    if (at_statement_end(p) || p.token.type == Token_Type::L_Bracket) {
+        report_error(p.token.line, "Expected a value, but the line ended.");
+        return nullptr;
+    }
+
+    auto token = p.token;
+    using enum Token_Type;
+    switch (token.type) {
+        case Word: {
+            auto expr   = new_expr(p, Expr_Kind::Constant, token.type);
+            expr->value = parse_value(p, token.text);
+            advance(p);
+            return expr;
+        }
+        case VariableUse: {
+            auto expr  = new_expr(p, Expr_Kind::Variable, token.type);
+            expr->name = intern(p, token.text);
+            advance(p);
+            return expr;
+        }
+        case XCOR:
+        case YCOR:
+        case HEADING:
+        case COLOR: {
+            auto expr = new_expr(p, Expr_Kind::Query, token.type);
+            advance(p);
+            return expr;
+        }
+        default:
+            break;
+    }
+    if (!is_binary_operator(token.type)) {
+        report_error(token.line, "Expected a value, but found '%.*s'.", (int)token.text.size(), token.text.data());
+        return nullptr;
+    }
+    auto expr = new_expr(p, Expr_Kind::Binary, token.type);
+    advance(p);
+    expr->lhs = parse_expression(p);
+    if (!expr->lhs) return nullptr;
+    expr->rhs = parse_expression(p);
+    if (!expr->rhs) return nullptr;
+    return expr;
+}
+
+// Parses the "name argument of MAKE / ADDASSIGN / TO.
+static bool parse_name(Parser& p, string_view& name) {
+    if (p.token.type != Token_Type::Word) {
+        report_error(p.token.line, "Expected a name like \"NAME.");
+        return false;
+    }
+    name = intern(p, p.token.text);
+    advance(p);
+    return true;
+}
+
+// Parses the `count` arguments that follow a command into an array sized for exactly that many.
+static bool parse_args(Parser& p, Stmt* stmt, size_t count) {
+    stmt->args = span(alloc<Expr*>(p.ast.arena.get(), count), count);
+    for (auto& arg : stmt->args) {
+        arg = parse_expression(p);
+        if (!arg) return false;
+    }
+    return true;
+}
+
+static bool expect_statement_end(const Parser& p) {
+    if (at_statement_end(p)) return true;
+    auto text = source_text(p.token);
+    report_error(p.token.line, "Unexpected '%.*s', every token on a line must be used.", (int)text.size(), text.data());
+    return false;
+}
+
+static bool open_block(Parser& p, Block_Kind kind, uint32_t line, Stmt_List* body) {
+    if (kind != Block_Kind::Procedure) {
+        if (p.token.type != Token_Type::L_Bracket) {
+            report_error(line, "Expected a '[' at the end of the line.");
+            return false;
+        }
+        advance(p);
+    }
+    p.blocks.push_back({kind, line, p.current});
+    p.current = body;
+    return true;
+}
+
+static bool close_block(Parser& p, Block_Kind kind) {
+    auto expected_procedure = kind == Block_Kind::Procedure;
+    if (p.blocks.empty() || (p.blocks.back().kind == Block_Kind::Procedure) != expected_procedure) {
+        report_error(p.token.line, "Found '%s' without a matching '%s'.", expected_procedure ? "END" : "]",
+                     expected_procedure ? "TO" : "[");
+        return false;
+    }
+    p.current = p.blocks.back().parent;
+    p.blocks.pop_back();
+    advance(p);
+    return expect_statement_end(p);
+}
+
+static bool parse_statement(Parser& p) {
+    auto token = p.token;
+    if (token.type == Token_Type::R_Bracket) return close_block(p, Block_Kind::If);
+    if (token.type == Token_Type::EndFn) return close_block(p, Block_Kind::Procedure);
+
+    auto type = parse_statement_type(token.type);
+    if (type == Statement_Type::Erroneous) {
+        report_error(token.line, "'%.*s' is not a command.", (int)token.text.size(), token.text.data());
+        return false;
+    }
+
+    auto stmt = new_stmt(p, type, token.type);
+    advance(p);
+    using enum Statement_Type;
+    switch (type) {
+        case Pen_Movement:
+            if (token.type != Token_Type::PENUP && token.type != Token_Type::PENDOWN) {
+                if (!parse_args(p, stmt, 1)) return false;
+            }
+            break;
+        case Pen_Color:
+            if (!parse_args(p, stmt, 1)) return false;
+            break;
+        case Frame:
+            break;
+        case Variable_Decleration:
+        case Add_Assign:
+            if (!parse_name(p, stmt->name) || !parse_args(p, stmt, 1)) return false;
+            break;
+        case If:
+        case While:
+            if (!parse_args(p, stmt, 1)) return false;
+            append(*p.current, stmt);
+            // The block's statements may carry on straight after the [, so there's no end of line to check.
+            return open_block(p, type == If ? Block_Kind::If : Block_Kind::While, stmt->line, &stmt->body);
+        case Function_Decleration: {
+            if (!p.blocks.empty()) {
+                report_error(stmt->line, "Procedures can only be declared at the top level.");
+                return false;
+            }
+            if (p.token.type != Token_Type::Identifier) {
+                report_error(stmt->line, "Expected a procedure name after TO.");
+                return false;
+            }
+            auto& procedure = p.ast.procedures.emplace_back();
+            procedure.name  = intern(p, p.token.text);
+            procedure.line  = stmt->line;
+            advance(p);
+            p.params.clear();
+            while (!at_statement_end(p)) {
+                if (!parse_name(p, p.params.emplace_back())) return false;
+            }
+            procedure.params = span(alloc<string_view>(p.ast.arena.get(), p.params.size()), p.params.size());
+            copy(p.params.begin(), p.params.end(), procedure.params.begin());
+            stmt->name      = procedure.name;
+            stmt->procedure = p.ast.procedures.size() - 1;
+            append(*p.current, stmt);
+            // Procedure bodies are stored on the declaration rather than the statement list.
+            return expect_statement_end(p) && open_block(p, Block_Kind::Procedure, stmt->line, &procedure.body);
+        }
+        case Procedure_Call: {
+            // Procedures are always declared above where they are used, so the name is already interned if it exists.
+            auto   name  = intern(p, token.text);
+            size_t index = 0;
+            while (index < p.ast.procedures.size() && p.ast.procedures[index].name.data() != name.data()) index++;
+            if (index == p.ast.procedures.size()) {
+                report_error(token.line, "'%.*s' is not a command or a known procedure.", (int)token.text.size(),
+                             token.text.data());
+                return false;
+            }
+            stmt->name      = name;
+            stmt->procedure = index;
+            if (!parse_args(p, stmt, p.ast.procedures[index].params.size())) return false;
+            break;
+        }
+        default:
+            report_error(token.line, "Trying to parse a type of statement we don't know how to handle.");
+            return false;
+    }
+    append(*p.current, stmt);
+    return expect_statement_end(p);
+}
+
+optional<Ast> parse_program(string_view source) {
+    TRACE_SCOPE("parse");
+    Parser p    = {};
+    p.ast.arena = Arena_Ptr(arena_new(AST_CHUNK_SIZE));
+    p.lexer     = make_lexer(source);
+    p.current   = &p.ast.top_level;
+    advance(p);
+    while (p.token.type != Token_Type::EndOfFile) {
+        if (p.token.type == Token_Type::Newline) {
+            advance(p);
+            continue;
+        }
+        if (!parse_statement(p)) return nullopt;
+    }
+    if (!p.blocks.empty()) {
+        auto& block = p.blocks.back();
+        report_error(block.line, "This %s is never closed with '%s'.",
+                     block.kind == Block_Kind::Procedure ? "procedure" : "block",
+                     block.kind == Block_Kind::Procedure ? "END" : "]");
+        return nullopt;
+    }
+    return std::move(p.ast);
+}
+
+/*
+    Optimization: AST -> AST.
+*/
+// Works out `lhs op rhs` exactly as the interpreter would, unless doing so would be an error, which is left for the
+// interpreter to report when it gets there.
+static bool fold_binary(Token_Type op, const Logo_Value& lhs, const Logo_Value& rhs, Logo_Value& result) {
+    using enum Token_Type;
+    if (op == EQ || op == NE) {
+        result = (lhs == rhs) == (op == EQ);
+        return true;
+    }
+    if (op == AND || op == OR) {
+        auto a = get_if<bool>(&lhs), b = get_if<bool>(&rhs);
+        if (!a || !b) return false;
+        result = op == AND ? *a && *b : *a || *b;
+        return true;
+    }
+    auto a = get_if<float>(&lhs), b = get_if<float>(&rhs);
+    if (!a || !b) return false;
+    switch (op) {
+        case Plus:
+            result = *a + *b;
+            return true;
+        case Minus:
+            result = *a - *b;
+            return true;
+        case Star:
+            result = *a * *b;
+            return true;
+        case Slash:
+            if (*b == 0) return false;
+            result = *a / *b;
+            return true;
+        case GT:
+            result = *a > *b;
+            return true;
+        default:
+            result = *a < *b;
+            return true;
+    }
+}
+
+static void fold_expression(Expr* expr) {
+    if (expr->kind != Expr_Kind::Binary) return;
+    fold_expression(expr->lhs);
+    fold_expression(expr->rhs);
+    if (expr->lhs->kind != Expr_Kind::Constant || expr->rhs->kind != Expr_Kind::Constant) return;
+    if (fold_binary(expr->op, expr->lhs->value, expr->rhs->value, expr->value)) expr->kind = Expr_Kind::Constant;
+}
+
+// What closed_form_loop found out about a loop.
+struct Loop_Shape {
+    string_view counter;
+    Token_Type  compare;
+    bool        counter_first;
+    float       limit;
+    float       step;
+};
+
+static const float* constant_number(const Expr* expr) {
+    return expr->kind == Expr_Kind::Constant ? get_if<float>(&expr->value) : nullptr;
+}
+
+// Appends the turtle commands `stmt` runs to `steps` if they all have a constant argument the interpreter would
+// accept. `stmt` is either one of those commands or a call to a procedure without parameters made of only those.
+static bool constant_motion(const Ast& ast, const Stmt* stmt, vector<const Stmt*>& steps, bool in_procedure) {
+    using enum Token_Type;
+    if (stmt->type == Statement_Type::Procedure_Call) {
+        // Procedures can call themselves, so only calls from the loop itself are looked into.
+        auto& procedure = ast.procedures[stmt->procedure];
+        if (in_procedure || !procedure.params.empty()) return false;
+        for (auto body_stmt : procedure.body) {
+            if (!constant_motion(ast, body_stmt, steps, true)) return false;
+        }
+        return true;
+    }
+    if (stmt->type != Statement_Type::Pen_Movement && stmt->type != Statement_Type::Pen_Color) return false;
+    if (stmt->command != PENUP && stmt->command != PENDOWN) {
+        auto amount = constant_number(stmt->args[0]);
+        if (!amount) return false;
+        bool whole = *amount == truncf(*amount);
+        if ((stmt->command == TURN || stmt->command == SETHEADING) && !whole) return false;
+        if (stmt->command == SETPENCOLOR && (!whole || *amount < 0 || *amount > 15)) return false;
+        if (stmt->command == SETPENSIZE && (!whole || *amount < 1 || *amount > MAX_PEN_SIZE)) return false;
+    }
+    steps.push_back(stmt);
+    return true;
+}
+
+// Matches `WHILE <EQ|NE|GT|LT> :counter "limit [ ... ]` (either way round) whose block is one ADDASSIGN of a
+// constant to the counter and otherwise only constant motion.
+static bool closed_form_loop(const Ast& ast, const Stmt* stmt, Loop_Shape& shape, vector<const Stmt*>& steps) {
+    using enum Token_Type;
+    auto condition = stmt->args[0];
+    if (condition->kind != Expr_Kind::Binary) return false;
+    if (condition->op != EQ && condition->op != NE && condition->op != GT && condition->op != LT) return false;
+    shape.compare       = condition->op;
+    shape.counter_first = condition->lhs->kind == Expr_Kind::Variable;
+    auto counter        = shape.counter_first ? condition->lhs : condition->rhs;
+    auto limit          = constant_number(shape.counter_first ? condition->rhs : condition->lhs);
+    if (counter->kind != Expr_Kind::Variable || !limit) return false;
+    shape.counter = counter->name;
+    shape.limit   = *limit;
+
+    bool counted = false;
+    for (auto body_stmt : stmt->body) {
+        if (body_stmt->type == Statement_Type::Add_Assign && body_stmt->name == shape.counter && !counted) {
+            auto step = constant_number(body_stmt->args[0]);
+            if (!step) return false;
+            shape.step = *step;
+            counted    = true;
+            continue;
+        }
+        if (!constant_motion(ast, body_stmt, steps, false)) return false;
+    }
+    return counted;
+}
+
+static void optimize_statements(const Ast& ast, Stmt_List& list) {
+    Stmt* previous = nullptr;
+    auto  link     = [&](Stmt* stmt) {
+        if (previous) {
+            previous->next = stmt;
+        } else {
+            list.first = stmt;
+        }
+    };
+    for (auto stmt = list.first; stmt;) {
+        auto next = stmt->next;
+        for (auto arg : stmt->args) fold_expression(arg);
+        optimize_statements(ast, stmt->body);
+
+        // An IF or WHILE whose condition folded to TRUE or FALSE either always or never runs its block.
+        const bool* condition = nullptr;
+        if ((stmt->type == Statement_Type::If || stmt->type == Statement_Type::While) &&
+            stmt->args[0]->kind == Expr_Kind::Constant) {
+            condition = get_if<bool>(&stmt->args[0]->value);
+        }
+        if (condition && !*condition) {
+            link(next);
+        } else if (condition && stmt->type == Statement_Type::If && stmt->body.first) {
+            link(stmt->body.first);
+            stmt->body.last->next = next;
+            previous              = stmt->body.last;
+        } else if (condition && stmt->type == Statement_Type::If) {
+            link(next);
+        } else {
+            if (stmt->type == Statement_Type::While) {
+                Loop_Shape          shape;
+                vector<const Stmt*> steps;
+                stmt->closed_form = closed_form_loop(ast, stmt, shape, steps);
+            }
+            link(stmt);
+            previous = stmt;
+        }
+        stmt = next;
+    }
+    list.last = previous;
+}
+
+// Folds constant expressions, drops IF and WHILE blocks that can never run, inlines IF blocks that always run and
+// marks the loops the code generator can turn into a Motion_Loop. Nothing that would report an error is changed, so
+// an optimized program reports the same errors as the original.
+void optimize(Ast& ast) {
+    TRACE_SCOPE("optimize");
+    for (auto& procedure : ast.procedures) optimize_statements(ast, procedure.body);
+    optimize_statements(ast, ast.top_level);
+}
+
+/*
+    Code generation: AST -> bytecode.
+*/
+struct Code_Generator {
+    const Ast*                       ast;
+    Program                          program;
+    map<string_view, int32_t>        global_slots; // Keyed by the AST's interned names.
+    map<string_view, uint32_t>       word_ids;
+    // Keyed by the tag above the value's bits. Generated scripts can have hundreds of thousands of distinct literals.
+    unordered_map<uint64_t, int32_t> constant_ids;
+    const Procedure_Decl*            procedure; // The procedure being generated, if any, for resolving locals.
+    // Call instructions waiting for the address of their procedure.
+    vector<pair<size_t, uint32_t>>   calls;
+};
+
+static size_t emit(Code_Generator& gen, Op_Code op, int32_t operand, uint32_t line) {
+    gen.program.code.push_back({op, operand});
+    gen.program.lines.push_back(line);
+    if constexpr (TRACE_ENABLED) gen.program.statement_commands.push_back(Token_Type::EndOfFile);
+    return gen.program.code.size() - 1;
+}
+
+static int32_t constant_index(Code_Generator& gen, const Logo_Value& value) {
+    Tagged_Value constant;
+    if (auto number = get_if<float>(&value)) {
+        constant = number_value(*number);
+    } else if (auto boolean = get_if<bool>(&value)) {
+        constant = bool_value(*boolean);
+    } else {
+        auto  text          = get<string_view>(value);
+        auto [it, inserted] = gen.word_ids.try_emplace(text, gen.program.words.size());
+        if (inserted) gen.program.words.emplace_back(text);
+        constant.tag  = Value_Tag::Word;
+        constant.word = it->second;
+    }
+
+    uint32_t bits = constant.tag == Value_Tag::Number    ? bit_cast<uint32_t>(constant.number)
+                    : constant.tag == Value_Tag::Boolean ? constant.boolean
+                                                         : constant.word;
+    auto& constants     = gen.program.constants;
+    auto [it, inserted] = gen.constant_ids.try_emplace((uint64_t)constant.tag << 32 | bits, constants.size());
+    if (inserted) constants.push_back(constant);
+    return it->second;
+}
+
+static int32_t global_slot(Code_Generator& gen, string_view name) {
+    auto it = gen.global_slots.find(name);
+    if (it != gen.global_slots.end()) return it->second;
+    gen.program.names.emplace_back(name);
+    gen.global_slots.emplace(name, gen.program.names.size() - 1);
+    return gen.program.names.size() - 1;
+}
+
+// Inside a procedure its parameters shadow globals of the same name, everything else is global.
+static int32_t local_slot(Code_Generator& gen, string_view name) {
+    if (!gen.procedure) return -1;
+    auto& params = gen.procedure->params;
+    for (size_t i = 0; i < params.size(); i++) {
+        if (params[i] == name) return i;
+    }
+    return -1;
+}
+
+// Emits `local` if the name is a parameter of the current procedure and `global` otherwise.
+static void emit_variable(Code_Generator& gen, Op_Code global, Op_Code local, string_view name, uint32_t line) {
+    auto slot = local_slot(gen, name);
+    if (slot >= 0) {
+        emit(gen, local, slot, line);
+    } else {
+        emit(gen, global, global_slot(gen, name), line);
+    }
+}
+
+static void patch_jump(Code_Generator& gen, size_t jump) {
+    gen.program.code[jump].operand = gen.program.code.size() - jump;
+}
+
+static Op_Code binary_op_code(Token_Type token) {
+    using enum Token_Type;
+    switch (token) {
+        case Plus:
+            return Op_Code::Add;
+        case Minus:
+            return Op_Code::Subtract;
+        case Star:
+            return Op_Code::Multiply;
+        case Slash:
+            return Op_Code::Divide;
+        case EQ:
+            return Op_Code::Eq;
+        case NE:
+            return Op_Code::Ne;
+        case GT:
+            return Op_Code::Gt;
+        case LT:
+            return Op_Code::Lt;
+        case AND:
+            return Op_Code::And;
+        default:
+            return Op_Code::Or;
+    }
+}
+
+static Op_Code command_op_code(Token_Type token) {
+    using enum Token_Type;
+    switch (token) {
+        case PENUP:
+            return Op_Code::Pen_Up;
+        case PENDOWN:
+            return Op_Code::Pen_Down;
+        case FORWARD:
+            return Op_Code::Forward;
+        case BACK:
+            return Op_Code::Back;
+        case LEFT:
+            return Op_Code::Left;
+        case RIGHT:
+            return Op_Code::Right;
+        case SETPENCOLOR:
+            return Op_Code::Set_Pen_Color;
+        case SETPENSIZE:
+            return Op_Code::Set_Pen_Size;
+        case TURN:
+            return Op_Code::Turn;
+        case SETHEADING:
+            return Op_Code::Set_Heading;
+        case SETX:
+            return Op_Code::Set_X;
+        default:
+            return Op_Code::Set_Y;
+    }
+}
+
+static void generate_expression(Code_Generator& gen, const Expr* expr) {
+    switch (expr->kind) {
+        case Expr_Kind::Constant:
+            emit(gen, Op_Code::Push_Constant, constant_index(gen, expr->value), expr->line);
+            return;
+        case Expr_Kind::Variable:
+            emit_variable(gen, Op_Code::Load_Global, Op_Code::Load_Local, expr->name, expr->line);
+            return;
+        case Expr_Kind::Query: {
+            auto op = expr->op == Token_Type::XCOR      ? Op_Code::Xcor
+                      : expr->op == Token_Type::YCOR    ? Op_Code::Ycor
+                      : expr->op == Token_Type::HEADING ? Op_Code::Heading
+                                                        : Op_Code::Color;
+            emit(gen, op, 0, expr->line);
+            return;
+        }
+        case Expr_Kind::Binary:
+            generate_expression(gen, expr->lhs);
+            generate_expression(gen, expr->rhs);
+            emit(gen, binary_op_code(expr->op), 0, expr->line);
+            return;
+    }
+}
+
+static size_t emit_motion_loop(Code_Generator& gen, const Stmt* stmt) {
+    Loop_Shape          shape;
+    vector<const Stmt*> steps;
+    closed_form_loop(*gen.ast, stmt, shape, steps);
+
+    Motion_Loop loop;
+    loop.compare       = binary_op_code(shape.compare);
+    loop.counter_first = shape.counter_first;
+    auto slot          = local_slot(gen, shape.counter);
+    loop.local         = slot >= 0;
+    loop.counter       = loop.local ? slot : global_slot(gen, shape.counter);
+    loop.limit         = shape.limit;
+    loop.step          = shape.step;
+    loop.first_motion  = gen.program.motions.size();
+    loop.motion_count  = steps.size();
+    loop.skip          = 0;
+    for (auto step : steps) {
+        auto amount = step->args.empty() ? 0 : get<float>(step->args[0]->value);
+        gen.program.motions.push_back({command_op_code(step->command), amount});
+    }
+    gen.program.motion_loops.push_back(loop);
+    return emit(gen, Op_Code::Motion_Loop, gen.program.motion_loops.size() - 1, stmt->line);
+}
+
+// Top-level statements are each preceded by a Statement marker, so execution can be checkpointed and resumed there.
+static void generate_statements(Code_Generator& gen, const Stmt_List& stmts, bool top_level) {
+    for (auto stmt : stmts) {
+        // Remember where the arguments start, a WHILE re-evaluates its condition from here every iteration.
+        auto start = gen.program.code.size();
+        if (top_level) {
+            gen.program.statement_starts.push_back(start);
+            gen.program.statement_lines.push_back(stmt->line);
+            emit(gen, Op_Code::Statement, gen.program.statement_starts.size() - 1, stmt->line);
+            start++;
+        }
+        // A closed form loop is preceded by its Motion_Loop, which normally skips the loop's own code entirely.
+        size_t motion_loop = 0;
+        if (stmt->closed_form) {
+            motion_loop = emit_motion_loop(gen, stmt);
+            start++;
+        }
+        for (auto arg : stmt->args) {
+            generate_expression(gen, arg);
+        }
+        using enum Statement_Type;
+        switch (stmt->type) {
+            case Pen_Movement:
+            case Pen_Color:
+                emit(gen, command_op_code(stmt->command), 0, stmt->line);
+                break;
+            case Frame:
+                emit(gen, Op_Code::Frame, 0, stmt->line);
+                break;
+            case Variable_Decleration:
+                emit_variable(gen, Op_Code::Store_Global, Op_Code::Store_Local, stmt->name, stmt->line);
+                break;
+            case Add_Assign:
+                emit_variable(gen, Op_Code::Add_Assign_Global, Op_Code::Add_Assign_Local, stmt->name, stmt->line);
+                break;
+            case If: {
+                auto skip = emit(gen, Op_Code::Jump_If_False, 0, stmt->line);
+                generate_statements(gen, stmt->body, false);
+                patch_jump(gen, skip);
+                break;
+            }
+            case While: {
+                auto exit = emit(gen, Op_Code::Jump_If_False, 0, stmt->line);
+                generate_statements(gen, stmt->body, false);
+                auto back = emit(gen, Op_Code::Jump, 0, stmt->line);
+                gen.program.code[back].operand = (int32_t)start - (int32_t)back;
+                patch_jump(gen, exit);
+                if (stmt->closed_form) {
+                    auto& code = gen.program.code;
+                    gen.program.motion_loops[code[motion_loop].operand].skip = code.size() - motion_loop;
+                }
+                break;
+            }
+            case Procedure_Call: {
+                auto call = emit(gen, Op_Code::Call, 0, stmt->line);
+                gen.calls.push_back({call, stmt->procedure});
+                break;
+            }
+            default:
+                break;
+        }
+        // A WHILE jumps back here for every test of its condition, so that's how often it counts as run.
+        if (TRACE_ENABLED && gen.program.code.size() > start) gen.program.statement_commands[start] = stmt->command;
+    }
+}
+
+Program generate_bytecode(const Ast& ast) {
+    TRACE_SCOPE("codegen");
+    Code_Generator gen;
+    gen.ast       = &ast;
+    gen.procedure = nullptr;
+    generate_statements(gen, ast.top_level, true);
+    emit(gen, Op_Code::Halt, 0, 0);
+
+    // Procedure bodies live after the main program, each one starts by moving its arguments into a frame.
+    vector<int32_t> entries;
+    for (auto& procedure : ast.procedures) {
+        gen.procedure = &procedure;
+        entries.push_back(emit(gen, Op_Code::Enter, procedure.params.size(), procedure.line));
+        generate_statements(gen, procedure.body, false);
+        emit(gen, Op_Code::Return, 0, procedure.line);
+    }
+    gen.procedure = nullptr;
+    for (auto [call, procedure] : gen.calls) {
+        gen.program.code[call].operand = entries[procedure];
+    }
+    return std::move(gen.program);
+}
+
+optional<Program> compile(string_view source) {
+    auto ast = parse_program(source);
+    if (!ast) return nullopt;
+    optimize(*ast);
+    return generate_bytecode(*ast);
+}
+
+/*
+    Disassembly.
+*/
+static const char* OP_NAMES[] = {
+    "Push_Constant", "Load_Global", "Store_Global", "Add_Assign_Global", "Load_Local", "Store_Local",
+    "Add_Assign_Local", "Xcor", "Ycor", "Heading", "Color", "Add", "Subtract", "Multiply", "Divide", "Eq", "Ne", "Gt",
+    "Lt", "And", "Or", "Pen_Up", "Pen_Down", "Forward", "Back", "Left", "Right", "Set_Pen_Color", "Set_Pen_Size",
+    "Turn", "Set_Heading", "Set_X", "Set_Y", "Frame", "Motion_Loop", "Statement", "Jump", "Jump_If_False", "Call",
+    "Enter", "Return", "Halt",
+};
+static_assert(size(OP_NAMES) == OP_CODE_COUNT);
+
+const char* op_code_name(Op_Code op) {
+    return OP_NAMES[(size_t)op];
+}
+
+static void dump_value(FILE* out, const Program& program, Tagged_Value value) {
+    switch (value.tag) {
+        case Value_Tag::Number:
+            fprintf(out, "%g", value.number);
+            break;
+        case Value_Tag::Boolean:
+            fprintf(out, value.boolean ? "TRUE" : "FALSE");
+            break;
+        case Value_Tag::Word:
+            fprintf(out, "\"%s", program.words[value.word].c_str());
+            break;
+        default:
+            break;
+    }
+}
+
+// Prints one instruction per line, with what its operand refers to spelled out.
+void dump_program(FILE* out, const Program& program) {
+    for (size_t pc = 0; pc < program.code.size(); pc++) {
+        auto instruction = program.code[pc];
+        fprintf(out, "%5zu  line %-4u %-17s %d", pc, program.lines[pc], OP_NAMES[(size_t)instruction.op],
+                instruction.operand);
+        using enum Op_Code;
+        switch (instruction.op) {
+            case Push_Constant:
+                fprintf(out, "  ; ");
+                dump_value(out, program, program.constants[instruction.operand]);
+                break;
+            case Load_Global:
+            case Store_Global:
+            case Add_Assign_Global:
+                fprintf(out, "  ; :%s", program.names[instruction.operand].c_str());
+                break;
+            case Jump:
+            case Jump_If_False:
+                fprintf(out, "  ; -> %zu", pc + instruction.operand);
+                break;
+            case Motion_Loop: {
+                auto& loop    = program.motion_loops[instruction.operand];
+                auto  counter = loop.local ? "local " + to_string(loop.counter) : ":" + program.names[loop.counter];
+                char  limit[32];
+                snprintf(limit, sizeof(limit), "%g", loop.limit);
+                fprintf(out, "  ; while %s %s %s, add %g, -> %zu:", OP_NAMES[(size_t)loop.compare],
+                        loop.counter_first ? counter.c_str() : limit, loop.counter_first ? limit : counter.c_str(),
+                        loop.step, pc + loop.skip);
+                for (uint32_t i = 0; i < loop.motion_count; i++) {
+                    auto motion = program.motions[loop.first_motion + i];
+                    fprintf(out, " %s", OP_NAMES[(size_t)motion.op]);
+                    if (motion.op != Pen_Up && motion.op != Pen_Down) fprintf(out, " %g", motion.amount);
+                }
+                break;
+            }
+            default:
+                break;
+        }
+        fputc('\n', out);
+    }
+}
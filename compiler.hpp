@@ -0,0 +1,259 @@
+#pragma once
+#include "lexer.hpp"
+#include "third_party/arena.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
+
+// Words are interned in the AST's arena, see Ast.
+typedef std::variant<float, bool, std::string_view> Logo_Value;
+
+enum class Statement_Type {
+    Function_Decleration,
+    Variable_Decleration,
+    Procedure_Call,
+    Pen_Movement,
+    Pen_Color, // SETPENCOLOR or SETPENSIZE, which both change what the pen draws with rather than where.
+    Add_Assign,
+    If,
+    While,
+    Frame,
+    Comment,
+    Erroneous
+};
+
+/*
+    AST.
+*/
+enum class Expr_Kind { Constant, Variable, Query, Binary };
+
+struct Expr {
+    Expr_Kind        kind;
+    Token_Type       op; // Which query or operator this is.
+    uint32_t         line;
+    Logo_Value       value; // Constant only.
+    std::string_view name;  // Variable only.
+    Expr*            lhs;
+    Expr*            rhs;
+};
+
+struct Stmt;
+
+// The statements of a block, linked through Stmt::next so the parser can keep appending without reallocating.
+struct Stmt_List {
+    Stmt* first;
+    Stmt* last;
+};
+
+struct Stmt {
+    Statement_Type   type;
+    Token_Type       command;
+    uint32_t         line;
+    std::string_view name;      // Variable being assigned / procedure being called.
+    uint32_t         procedure; // Index into Ast::procedures for calls and declerations.
+    std::span<Expr*> args;
+    Stmt_List        body; // IF / WHILE blocks.
+    Stmt*            next;
+    // Set by optimize() on a WHILE that counts a variable up or down and otherwise only moves the turtle by constants.
+    bool             closed_form;
+};
+
+struct Stmt_Iterator {
+    Stmt* stmt;
+
+    Stmt*          operator*() const { return stmt; }
+    Stmt_Iterator& operator++() {
+        stmt = stmt->next;
+        return *this;
+    }
+    bool operator!=(const Stmt_Iterator& other) const { return stmt != other.stmt; }
+};
+
+inline Stmt_Iterator begin(const Stmt_List& list) {
+    return {list.first};
+}
+
+inline Stmt_Iterator end(const Stmt_List&) {
+    return {nullptr};
+}
+
+struct Procedure_Decl {
+    std::string_view            name;
+    std::span<std::string_view> params;
+    Stmt_List                   body;
+    uint32_t                    line;
+};
+
+// Every node, argument list and name is allocated in the arena, names and words interned so equal ones share a
+// single copy. The whole tree is freed in one go with the arena, and it doesn't point into the source text.
+struct Ast {
+    Arena_Ptr                   arena;
+    std::vector<Procedure_Decl> procedures;
+    Stmt_List                   top_level;
+};
+
+/*
+    Bytecode.
+*/
+enum class Value_Tag : uint8_t { Unset, Number, Boolean, Word };
+
+// What the interpreter computes with. Words are interned when compiling, so comparing two of them is comparing
+// their index into Program::words.
+struct Tagged_Value {
+    Value_Tag tag;
+    union {
+        float    number;
+        bool     boolean;
+        uint32_t word;
+    };
+};
+
+inline Tagged_Value number_value(float number) {
+    Tagged_Value value;
+    value.tag    = Value_Tag::Number;
+    value.number = number;
+    return value;
+}
+
+inline Tagged_Value bool_value(bool boolean) {
+    Tagged_Value value;
+    value.tag     = Value_Tag::Boolean;
+    value.boolean = boolean;
+    return value;
+}
+
+inline bool operator==(Tagged_Value a, Tagged_Value b) {
+    if (a.tag != b.tag) return false;
+    switch (a.tag) {
+        case Value_Tag::Number:
+            return a.number == b.number;
+        case Value_Tag::Boolean:
+            return a.boolean == b.boolean;
+        case Value_Tag::Word:
+            return a.word == b.word;
+        default:
+            return true;
+    }
+}
+
+enum class Op_Code : uint8_t {
+    // Operand is an index into Program::constants.
+    Push_Constant,
+    // Operand is a global variable slot, see Program::names.
+    Load_Global,
+    Store_Global,
+    Add_Assign_Global,
+    // Operand is a slot in the current procedure's frame.
+    Load_Local,
+    Store_Local,
+    Add_Assign_Local,
+
+    // Queries, push a float.
+    Xcor,
+    Ycor,
+    Heading,
+    Color,
+
+    // Pop two values and push the result.
+    Add,
+    Subtract,
+    Multiply,
+    Divide,
+    Eq,
+    Ne,
+    Gt,
+    Lt,
+    And,
+    Or,
+
+    // Turtle control, all but Pen_Up/Pen_Down pop their argument.
+    Pen_Up,
+    Pen_Down,
+    Forward,
+    Back,
+    Left,
+    Right,
+    Set_Pen_Color,
+    Set_Pen_Size,
+    Turn,
+    Set_Heading,
+    Set_X,
+    Set_Y,
+    // Ends an animation frame, see Interpreter::frames.
+    Frame,
+
+    // Operand is an index into Program::motion_loops. Runs the whole loop that follows and jumps past it, unless the
+    // counter isn't a number, in which case it falls through so the loop's own code reports the error.
+    Motion_Loop,
+
+    // Marks the start of a top-level statement, operand is its index. Does nothing unless checkpoints are recorded.
+    Statement,
+
+    // Operand is an offset relative to the jump itself.
+    Jump,
+    Jump_If_False,
+    // Operand is the absolute address of the procedure's first instruction.
+    Call,
+    // First instruction of every procedure, operand is how many arguments to pop into a new frame.
+    Enter,
+    Return,
+    Halt,
+};
+
+constexpr size_t OP_CODE_COUNT = (size_t)Op_Code::Halt + 1;
+
+// The widest pen SETPENSIZE takes, in pixels.
+constexpr int MAX_PEN_SIZE = 64;
+
+struct Instruction {
+    Op_Code op;
+    int32_t operand;
+};
+
+// One step of a closed form loop: a turtle control op whose constant argument has already been checked.
+struct Motion {
+    Op_Code op;
+    float   amount;
+};
+
+// `WHILE <compare> :counter "limit [ ... ]` whose block adds a constant to the counter once and otherwise only runs
+// Motions, so every iteration can be done without going through the bytecode.
+struct Motion_Loop {
+    Op_Code  compare;       // Eq, Ne, Gt or Lt.
+    bool     counter_first; // Whether the counter is the comparison's left hand side.
+    bool     local;         // Whether the counter is a slot in the current frame rather than a global one.
+    int32_t  counter;
+    float    limit;
+    float    step;
+    uint32_t first_motion; // Index into Program::motions.
+    uint32_t motion_count;
+    int32_t  skip; // Offset from the Motion_Loop instruction to just past the loop.
+};
+
+struct Program {
+    std::vector<Instruction>  code;
+    std::vector<uint32_t>     lines; // Source line of each instruction, for error messages.
+    // Only filled in traced builds: the command of the statement each instruction is the first one of, EndOfFile for
+    // the rest. A procedure call's is Identifier.
+    std::vector<Token_Type>   statement_commands;
+    std::vector<Tagged_Value> constants;
+    std::vector<std::string>  words; // Interned text of every Value_Tag::Word.
+    std::vector<std::string>  names; // Name of each global variable slot.
+    // Address of the Statement instruction, and the source line, of every top-level statement.
+    std::vector<uint32_t>     statement_starts;
+    std::vector<uint32_t>     statement_lines;
+    std::vector<Motion>       motions;
+    std::vector<Motion_Loop>  motion_loops;
+};
+
+std::optional<Ast>     parse_program(std::string_view source);
+void                   optimize(Ast& ast);
+Program                generate_bytecode(const Ast& ast);
+std::optional<Program> compile(std::string_view source);
+void                   dump_program(FILE* out, const Program& program);
+const char*            op_code_name(Op_Code op);
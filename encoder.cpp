@@ -0,0 +1,287 @@
+#include "encoder.hpp"
+#include "trace.hpp"
+#include "util.hpp"
+#include <bit>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <vector>
+#include <zlib.h>
+
+using namespace std;
+
+// Olive's 0xAABBGGRR pixels are R, G, B, A in memory on little endian machines, which is exactly PNG and PAM's
+// byte order, so rows are written straight out of the canvas.
+static_assert(endian::native == endian::little);
+
+constexpr size_t OUTPUT_BUFFER_SIZE = 64 * 1024;
+
+const char* image_extension(Image_Format format) {
+    switch (format) {
+        case Image_Format::Png:
+            return ".png";
+        case Image_Format::Ppm:
+            return ".ppm";
+        case Image_Format::Pam:
+            return ".pam";
+    }
+    return "";
+}
+
+optional<Image_Format> parse_image_format(string_view name) {
+    if (name == "png") return Image_Format::Png;
+    if (name == "ppm") return Image_Format::Ppm;
+    if (name == "pam") return Image_Format::Pam;
+    return nullopt;
+}
+
+optional<Png_Filter> parse_png_filter(string_view name) {
+    if (name == "none") return Png_Filter::None;
+    if (name == "sub") return Png_Filter::Sub;
+    if (name == "up") return Png_Filter::Up;
+    if (name == "average") return Png_Filter::Average;
+    if (name == "paeth") return Png_Filter::Paeth;
+    if (name == "adaptive") return Png_Filter::Adaptive;
+    return nullopt;
+}
+
+static const uint8_t* canvas_row(Olivec_Canvas canvas, size_t y) {
+    return (const uint8_t*)&OLIVEC_PIXEL(canvas, 0, y);
+}
+
+/*
+    Raw formats, one fwrite per row.
+*/
+static bool write_raw(FILE* file, Olivec_Canvas canvas, Image_Format format) {
+    if (format == Image_Format::Pam) {
+        fprintf(file, "P7\nWIDTH %zu\nHEIGHT %zu\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n", canvas.width,
+                canvas.height);
+        for (size_t y = 0; y < canvas.height; y++) fwrite(canvas_row(canvas, y), 4, canvas.width, file);
+        return true;
+    }
+
+    // PPM has no alpha channel, so every row is repacked as RGB.
+    fprintf(file, "P6\n%zu %zu\n255\n", canvas.width, canvas.height);
+    vector<uint8_t> rgb(canvas.width * 3);
+    for (size_t y = 0; y < canvas.height; y++) {
+        auto row = canvas_row(canvas, y);
+        for (size_t x = 0; x < canvas.width; x++) memcpy(&rgb[x * 3], &row[x * 4], 3);
+        fwrite(rgb.data(), 1, rgb.size(), file);
+    }
+    return true;
+}
+
+/*
+    PNG.
+*/
+static void put_u32(uint8_t* out, uint32_t value) {
+    out[0] = value >> 24;
+    out[1] = value >> 16;
+    out[2] = value >> 8;
+    out[3] = value;
+}
+
+static void write_chunk(FILE* file, const char* type, const uint8_t* data, size_t size) {
+    uint8_t header[8], crc[4];
+    put_u32(header, size);
+    memcpy(header + 4, type, 4);
+    // zlib treats a null buffer as a request for the initial CRC, so empty chunks must skip the second call.
+    auto checksum = crc32(0, (const Bytef*)type, 4);
+    if (size > 0) checksum = crc32(checksum, data, size);
+    put_u32(crc, checksum);
+    fwrite(header, 1, sizeof(header), file);
+    if (size > 0) fwrite(data, 1, size, file);
+    fwrite(crc, 1, sizeof(crc), file);
+}
+
+static uint8_t paeth(int a, int b, int c) {
+    int p = a + b - c, pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+    return pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+}
+
+// Writes the filter type byte followed by the filtered row. The row above is null for the first row of the image.
+static void filter_row(Png_Filter filter, const uint8_t* row, const uint8_t* above, size_t size, uint8_t* out) {
+    constexpr size_t BPP = 4;
+    out[0]               = (uint8_t)filter;
+    out++;
+    for (size_t i = 0; i < size; i++) {
+        int a = i >= BPP ? row[i - BPP] : 0;
+        int b = above ? above[i] : 0;
+        int c = above && i >= BPP ? above[i - BPP] : 0;
+        switch (filter) {
+            case Png_Filter::Sub:
+                out[i] = row[i] - a;
+                break;
+            case Png_Filter::Up:
+                out[i] = row[i] - b;
+                break;
+            case Png_Filter::Average:
+                out[i] = row[i] - (a + b) / 2;
+                break;
+            case Png_Filter::Paeth:
+                out[i] = row[i] - paeth(a, b, c);
+                break;
+            default:
+                out[i] = row[i];
+                break;
+        }
+    }
+}
+
+// The usual heuristic: treat every filtered byte as signed and prefer the row whose bytes are closest to zero.
+static size_t filter_cost(const uint8_t* filtered, size_t size) {
+    size_t cost = 0;
+    for (size_t i = 1; i < size; i++) cost += abs((int8_t)filtered[i]);
+    return cost;
+}
+
+struct Row_Filter {
+    Png_Filter      filter;
+    vector<uint8_t> best;
+    vector<uint8_t> candidate;
+};
+
+static const vector<uint8_t>& filter_row(Row_Filter& state, Olivec_Canvas canvas, size_t y) {
+    auto row   = canvas_row(canvas, y);
+    auto above = y > 0 ? canvas_row(canvas, y - 1) : nullptr;
+    auto size  = canvas.width * 4;
+    if (state.filter != Png_Filter::Adaptive) {
+        filter_row(state.filter, row, above, size, state.best.data());
+        return state.best;
+    }
+    size_t best_cost = SIZE_MAX;
+    for (auto filter : {Png_Filter::None, Png_Filter::Sub, Png_Filter::Up, Png_Filter::Average, Png_Filter::Paeth}) {
+        filter_row(filter, row, above, size, state.candidate.data());
+        auto cost = filter_cost(state.candidate.data(), state.candidate.size());
+        if (cost < best_cost) {
+            best_cost = cost;
+            swap(state.best, state.candidate);
+        }
+    }
+    return state.best;
+}
+
+// Filters rows [first, last) and pushes them through `stream`, handing each buffer of compressed output to `emit` as
+// soon as it fills up. `final_flush` is applied after the last row. If `adler` is given the checksum of the filtered
+// rows is accumulated into it, for streams that don't keep their own.
+static bool deflate_rows(z_stream& stream, Olivec_Canvas canvas, size_t first, size_t last, Png_Filter filter,
+                         int final_flush, const function<void(const uint8_t*, size_t)>& emit, uLong* adler) {
+    Row_Filter state = {filter, vector<uint8_t>(1 + canvas.width * 4), vector<uint8_t>(1 + canvas.width * 4)};
+    uint8_t    out[OUTPUT_BUFFER_SIZE];
+    for (size_t y = first; y < last; y++) {
+        auto& filtered = filter_row(state, canvas, y);
+        if (adler) *adler = adler32(*adler, filtered.data(), filtered.size());
+
+        auto flush       = y + 1 == last ? final_flush : Z_NO_FLUSH;
+        stream.next_in   = (Bytef*)filtered.data();
+        stream.avail_in  = filtered.size();
+        do {
+            stream.next_out  = out;
+            stream.avail_out = sizeof(out);
+            auto status      = deflate(&stream, flush);
+            if (status == Z_STREAM_ERROR) return false;
+            if (sizeof(out) > stream.avail_out) emit(out, sizeof(out) - stream.avail_out);
+        } while (stream.avail_out == 0);
+    }
+    return true;
+}
+
+// One zlib stream for the whole image, every full output buffer goes straight out as its own IDAT chunk.
+static bool write_png_stream(FILE* file, Olivec_Canvas canvas, const Encode_Options& options) {
+    z_stream stream = {};
+    if (deflateInit(&stream, options.level) != Z_OK) return false;
+    auto success = deflate_rows(stream, canvas, 0, canvas.height, options.filter, Z_FINISH,
+                                [&](const uint8_t* data, size_t size) { write_chunk(file, "IDAT", data, size); },
+                                nullptr);
+    deflateEnd(&stream);
+    return success;
+}
+
+// Every band is compressed on its own as raw deflate. All but the last end with a sync flush, which byte-aligns
+// them, so the bands can simply be concatenated behind one zlib header with the checksums combined at the end.
+static bool write_png_bands(FILE* file, Olivec_Canvas canvas, const Encode_Options& options) {
+    auto                    rows  = options.band_rows;
+    auto                    count = (canvas.height + rows - 1) / rows;
+    vector<vector<uint8_t>> bands(count);
+    vector<uLong>           adlers(count, adler32(0, nullptr, 0));
+    vector<char>            failed(count, false);
+
+    pool_parallel_for(*options.pool, count, [&](size_t band) {
+        z_stream stream = {};
+        if (deflateInit2(&stream, options.level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            failed[band] = true;
+            return;
+        }
+        auto first = band * rows, last = min(first + rows, (size_t)canvas.height);
+        auto flush = band + 1 == count ? Z_FINISH : Z_SYNC_FLUSH;
+        auto& out  = bands[band];
+        failed[band] = !deflate_rows(stream, canvas, first, last, options.filter, flush,
+                                     [&](const uint8_t* data, size_t size) { out.insert(out.end(), data, data + size); },
+                                     &adlers[band]);
+        deflateEnd(&stream);
+    });
+    for (auto band_failed : failed) {
+        if (band_failed) return false;
+    }
+
+    // 0x78 0x01: deflate with a 32K window, no preset dictionary, and a check value that makes the header valid.
+    const uint8_t header[2] = {0x78, 0x01};
+    write_chunk(file, "IDAT", header, sizeof(header));
+    auto adler = adler32(0, nullptr, 0);
+    for (size_t band = 0; band < count; band++) {
+        write_chunk(file, "IDAT", bands[band].data(), bands[band].size());
+        auto band_rows = min(rows, canvas.height - band * rows);
+        adler          = adler32_combine(adler, adlers[band], band_rows * (1 + canvas.width * 4));
+    }
+    uint8_t trailer[4];
+    put_u32(trailer, adler);
+    write_chunk(file, "IDAT", trailer, sizeof(trailer));
+    return true;
+}
+
+static bool write_png(FILE* file, Olivec_Canvas canvas, size_t x, size_t y, const Encode_Options& options) {
+    const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    fwrite(signature, 1, sizeof(signature), file);
+
+    // 8 bits per channel RGBA, no interlacing.
+    uint8_t header[13] = {};
+    put_u32(header, canvas.width);
+    put_u32(header + 4, canvas.height);
+    header[8] = 8;
+    header[9] = 6;
+    write_chunk(file, "IHDR", header, sizeof(header));
+    if (x > 0 || y > 0) {
+        // Where the image sits on the page, in pixels.
+        uint8_t offset[9] = {};
+        put_u32(offset, x);
+        put_u32(offset + 4, y);
+        write_chunk(file, "oFFs", offset, sizeof(offset));
+    }
+
+    auto banded  = options.pool && options.band_rows > 0 && canvas.height > options.band_rows;
+    auto success = banded ? write_png_bands(file, canvas, options) : write_png_stream(file, canvas, options);
+    write_chunk(file, "IEND", nullptr, 0);
+    return success;
+}
+
+bool write_image(const char* path, Olivec_Canvas canvas, const Encode_Options& options) {
+    return write_image_at(path, canvas, 0, 0, options);
+}
+
+bool write_image_at(const char* path, Olivec_Canvas canvas, size_t x, size_t y, const Encode_Options& options) {
+    TRACE_SCOPE("encode");
+    auto file = fopen(path, "wb");
+    if (!file) {
+        fprintf(error_output, "ERROR! Couldn't open '%s' for writing.\n", path);
+        return false;
+    }
+    setvbuf(file, nullptr, _IOFBF, OUTPUT_BUFFER_SIZE);
+
+    auto success = options.format == Image_Format::Png ? write_png(file, canvas, x, y, options)
+                                                       : write_raw(file, canvas, options.format);
+    TRACE_COUNT(Bytes_Encoded, ftell(file));
+    success      = !ferror(file) && success;
+    success      = fclose(file) == 0 && success;
+    if (!success) fprintf(error_output, "ERROR! Couldn't write '%s'.\n", path);
+    return success;
+}
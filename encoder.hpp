@@ -0,0 +1,31 @@
+#pragma once
+#include "third_party/olive.h"
+#include "thread_pool.hpp"
+#include <cstddef>
+#include <optional>
+#include <string_view>
+
+enum class Image_Format { Png, Ppm, Pam };
+
+// The PNG row filters, plus Adaptive which tries all of them on every row and keeps whichever leaves the smallest
+// sum of absolute differences. Better filters compress better but cost more time per row.
+enum class Png_Filter { None, Sub, Up, Average, Paeth, Adaptive };
+
+struct Encode_Options {
+    Image_Format format;
+    int          level;  // zlib compression level for PNG, 0 (stored) to 9 (smallest).
+    Png_Filter   filter;
+    // Compress PNGs in independent bands of this many rows on `pool`. 0, or no pool, streams the image in one go.
+    size_t       band_rows;
+    Thread_Pool* pool;
+};
+
+// Streams the canvas to `path` a few rows at a time, so the whole encoded image never has to sit in memory.
+bool write_image(const char* path, Olivec_Canvas canvas, const Encode_Options& options);
+// Writes `canvas` as the piece of a bigger image whose top left corner is at (x, y). PNGs record the position in an
+// oFFs chunk, the raw formats have nowhere to put it.
+bool write_image_at(const char* path, Olivec_Canvas canvas, size_t x, size_t y, const Encode_Options& options);
+
+const char*                 image_extension(Image_Format format);
+std::optional<Image_Format> parse_image_format(std::string_view name);
+std::optional<Png_Filter>   parse_png_filter(std::string_view name);
@@ -0,0 +1,556 @@
+#include "interpreter.hpp"
+#include "trace.hpp"
+#include "util.hpp"
+#include <algorithm>
+#include <cmath>
+#include <span>
+#include <vector>
+
+using namespace std;
+
+// Clears the display list and puts the turtle in the middle of the canvas, facing up, with a white one pixel pen up.
+void reset_interpreter(Interpreter& ctx, uint32_t width, uint32_t height) {
+    ctx.width  = width;
+    ctx.height = height;
+    display_list_clear(ctx.display_list);
+    ctx.frames.clear();
+    ctx.variables.clear();
+    set_direction(ctx.pen_state, 0);
+    ctx.pen_state.down   = false;
+    ctx.pen_state.pos[0] = width / 2.0;
+    ctx.pen_state.pos[1] = height / 2.0;
+    ctx.pen_state.color  = 7;
+    ctx.pen_state.size   = 1;
+    ctx.checkpoints      = nullptr;
+}
+
+// Sine and cosine of every whole degree. TURN and SETHEADING only take whole numbers, so this covers every heading a
+// program can reach, and the angles that have exact values (multiples of 90, 30 and 45) get them instead of whatever
+// sin and cos round a multiple of pi/180 to.
+struct Heading_Table {
+    double sine[360];
+    double cosine[360];
+};
+
+static const Heading_Table& heading_table() {
+    static const Heading_Table table = [] {
+        // The first quadrant, every other one is a reflection of it.
+        double quadrant[91];
+        for (int degrees = 0; degrees <= 90; degrees++) quadrant[degrees] = sin(degree_to_radians(degrees));
+        quadrant[0]  = 0;
+        quadrant[30] = 0.5;
+        quadrant[45] = sqrt(0.5);
+        quadrant[60] = sqrt(3.0) / 2;
+        quadrant[90] = 1;
+
+        Heading_Table table;
+        for (int degrees = 0; degrees < 360; degrees++) {
+            int  within = degrees % 90;
+            auto sine   = degrees / 90 % 2 == 0 ? quadrant[within] : quadrant[90 - within];
+            auto cosine = degrees / 90 % 2 == 0 ? quadrant[90 - within] : quadrant[within];
+            table.sine[degrees]   = degrees < 180 ? sine : -sine;
+            table.cosine[degrees] = degrees < 90 || degrees >= 270 ? cosine : -cosine;
+        }
+        return table;
+    }();
+    return table;
+}
+
+// Sets the heading and works out its unit vector, so moves don't have to until the heading changes again.
+void set_direction(Pen_State& pen_state, float degrees) {
+    pen_state.direction = degrees;
+    // Headings aren't normalised, so wrap before converting or large headings lose precision.
+    auto wrapped = fmod(degrees, 360.0);
+    if (wrapped == trunc(wrapped)) {
+        auto& table       = heading_table();
+        auto  index       = (int)wrapped + (wrapped < 0 ? 360 : 0);
+        pen_state.unit[0] = table.sine[index];
+        pen_state.unit[1] = table.cosine[index];
+        return;
+    }
+    auto radians      = degree_to_radians(wrapped);
+    pen_state.unit[0] = sin(radians);
+    pen_state.unit[1] = cos(radians);
+}
+
+// Heading 0 is up the screen and headings grow clockwise, LEFT/RIGHT move perpendicular to it.
+static void move_step(const Pen_State& pen_state, Direction direction, float amount, double step[2]) {
+    auto sine = pen_state.unit[0], cosine = pen_state.unit[1];
+    switch (direction) {
+        case Direction::Forward:
+            break;
+        case Direction::Back:
+            amount = -amount;
+            break;
+        case Direction::Left:
+            sine   = -pen_state.unit[1];
+            cosine = pen_state.unit[0];
+            break;
+        case Direction::Right:
+            sine   = pen_state.unit[1];
+            cosine = -pen_state.unit[0];
+            break;
+    }
+    step[0] = sine * amount;
+    step[1] = -cosine * amount;
+}
+
+// Moves `count` times by `amount`, recording a line for every move if the pen is down. This is the only function
+// that draws a line. Every position is worked out from where the turtle started rather than from the move before,
+// so a long run of moves doesn't pile up rounding error.
+void move_pen_repeat(Interpreter& ctx, Direction direction, float amount, size_t count) {
+    auto&  pen_state = ctx.pen_state;
+    double step[2];
+    move_step(pen_state, direction, amount, step);
+    double start[2] = {pen_state.pos[0], pen_state.pos[1]};
+    for (size_t i = 1; i <= count; i++) {
+        double new_pos[2] = {start[0] + step[0] * i, start[1] + step[1] * i};
+        if (pen_state.down) {
+            display_list_push(ctx.display_list, pen_state.pos, new_pos, pen_state.color, pen_state.size);
+        }
+        pen_state.pos[0] = new_pos[0];
+        pen_state.pos[1] = new_pos[1];
+    }
+}
+
+void move_pen(Interpreter& ctx, Direction direction, float amount) {
+    move_pen_repeat(ctx, direction, amount, 1);
+}
+
+static Direction move_direction(Op_Code op) {
+    return op == Op_Code::Forward ? Direction::Forward
+           : op == Op_Code::Back  ? Direction::Back
+           : op == Op_Code::Left  ? Direction::Left
+                                  : Direction::Right;
+}
+
+static bool is_move(Op_Code op) {
+    return op == Op_Code::Forward || op == Op_Code::Back || op == Op_Code::Left || op == Op_Code::Right;
+}
+
+static void apply_motion(Interpreter& ctx, Motion motion) {
+    using enum Op_Code;
+    switch (motion.op) {
+        case Pen_Up:
+            ctx.pen_state.down = false;
+            break;
+        case Pen_Down:
+            ctx.pen_state.down = true;
+            break;
+        case Set_Pen_Color:
+            ctx.pen_state.color = motion.amount;
+            break;
+        case Set_Pen_Size:
+            ctx.pen_state.size = motion.amount;
+            break;
+        case Turn:
+            set_direction(ctx.pen_state, ctx.pen_state.direction + motion.amount);
+            break;
+        case Set_Heading:
+            set_direction(ctx.pen_state, motion.amount);
+            break;
+        case Set_X:
+            ctx.pen_state.pos[0] = motion.amount;
+            break;
+        case Set_Y:
+            ctx.pen_state.pos[1] = motion.amount;
+            break;
+        default:
+            move_pen(ctx, move_direction(motion.op), motion.amount);
+            break;
+    }
+}
+
+// Runs a closed form loop without going through the bytecode. If the loop makes one move and otherwise only sets
+// the pen, every move after the first happens with the same pen in the same direction, so they're all done with a
+// single move_pen_repeat.
+static void run_motion_loop(Interpreter& ctx, const Program& program, const Motion_Loop& loop, float& counter) {
+    auto motions = span(program.motions).subspan(loop.first_motion, loop.motion_count);
+    auto more    = [&] {
+        auto lhs = loop.counter_first ? counter : loop.limit;
+        auto rhs = loop.counter_first ? loop.limit : counter;
+        switch (loop.compare) {
+            case Op_Code::Eq:
+                return lhs == rhs;
+            case Op_Code::Ne:
+                return lhs != rhs;
+            case Op_Code::Gt:
+                return lhs > rhs;
+            default:
+                return lhs < rhs;
+        }
+    };
+
+    size_t moves = 0, move = 0;
+    bool   steers = false;
+    for (size_t i = 0; i < motions.size(); i++) {
+        auto op = motions[i].op;
+        if (is_move(op)) moves++, move = i;
+        steers |= op == Op_Code::Turn || op == Op_Code::Set_Heading || op == Op_Code::Set_X || op == Op_Code::Set_Y;
+    }
+    if (moves != 1 || steers) {
+        for (; more(); counter += loop.step) {
+            TRACE_COUNT(Motion_Iterations, 1);
+            for (auto motion : motions) apply_motion(ctx, motion);
+        }
+        return;
+    }
+
+    size_t iterations = 0;
+    for (; more(); counter += loop.step) iterations++;
+    TRACE_COUNT(Motion_Iterations, iterations);
+    if (iterations == 0) return;
+    auto before = motions.first(move), after = motions.subspan(move + 1);
+    for (auto motion : before) apply_motion(ctx, motion);
+    apply_motion(ctx, motions[move]);
+    if (iterations > 1) {
+        for (auto motion : after) apply_motion(ctx, motion);
+        for (auto motion : before) apply_motion(ctx, motion);
+        move_pen_repeat(ctx, move_direction(motions[move].op), motions[move].amount, iterations - 1);
+    }
+    for (auto motion : after) apply_motion(ctx, motion);
+}
+
+static string value_to_string(const Program& program, Tagged_Value value) {
+    switch (value.tag) {
+        case Value_Tag::Number: {
+            char buffer[32];
+            snprintf(buffer, sizeof(buffer), "%g", value.number);
+            return buffer;
+        }
+        case Value_Tag::Boolean:
+            return value.boolean ? "TRUE" : "FALSE";
+        case Value_Tag::Word:
+            return program.words[value.word];
+        default:
+            return "";
+    }
+}
+
+struct Frame {
+    uint32_t return_pc;
+    uint32_t base; // Where the caller's locals start.
+};
+
+// Checkpoints are only taken once the program has moved on this far since the last one, so they stay cheap even
+// for files with thousands of short top-level statements.
+constexpr size_t CHECKPOINT_SEGMENTS   = 512;
+constexpr size_t CHECKPOINT_STATEMENTS = 16;
+
+static void take_checkpoint(Interpreter& ctx, const Program& program, uint32_t statement) {
+    auto& checkpoints = *ctx.checkpoints;
+    if (!checkpoints.empty()) {
+        auto& last = checkpoints.back();
+        if (last.statement >= statement) return;
+        auto segments = display_list_size(ctx.display_list) - last.segments;
+        if (segments < CHECKPOINT_SEGMENTS && statement - last.statement < CHECKPOINT_STATEMENTS) return;
+    }
+
+    auto& checkpoint     = checkpoints.emplace_back();
+    checkpoint.statement = statement;
+    checkpoint.pen_state = ctx.pen_state;
+    checkpoint.segments  = display_list_size(ctx.display_list);
+    checkpoint.frames    = ctx.frames.size();
+    for (size_t slot = 0; slot < ctx.variables.size(); slot++) {
+        auto value = ctx.variables[slot];
+        if (value.tag == Value_Tag::Unset) continue;
+        auto word = value.tag == Value_Tag::Word ? program.words[value.word] : "";
+        checkpoint.variables.push_back({program.names[slot], value, word});
+    }
+}
+
+// Puts the interpreter back how it was at the checkpoint, with the variables moved into `program`'s slots. The
+// program has to be identical to the one the checkpoint was taken from up to the checkpoint's statement.
+void restore_checkpoint(Interpreter& ctx, Program& program, const Checkpoint& checkpoint) {
+    Tagged_Value unset;
+    unset.tag = Value_Tag::Unset;
+    ctx.variables.assign(program.names.size(), unset);
+    for (auto& saved : checkpoint.variables) {
+        auto slot = find(program.names.begin(), program.names.end(), saved.name) - program.names.begin();
+        // A variable the new program never mentions can't affect it.
+        if (slot == (ptrdiff_t)program.names.size()) continue;
+        auto value = saved.value;
+        if (value.tag == Value_Tag::Word) {
+            auto word  = find(program.words.begin(), program.words.end(), saved.word) - program.words.begin();
+            if (word == (ptrdiff_t)program.words.size()) program.words.push_back(saved.word);
+            value.word = word;
+        }
+        ctx.variables[slot] = value;
+    }
+    ctx.pen_state = checkpoint.pen_state;
+    auto& list    = ctx.display_list;
+    for (auto column : {&list.x0, &list.y0, &list.x1, &list.y1}) column->resize(checkpoint.segments);
+    list.color.resize(checkpoint.segments);
+    list.width.resize(checkpoint.segments);
+    ctx.frames.resize(checkpoint.frames);
+}
+
+bool run(Interpreter& ctx, const Program& program) {
+    // Every global slot starts unset, reading one before it's assigned is an error.
+    Tagged_Value unset;
+    unset.tag = Value_Tag::Unset;
+    ctx.variables.assign(program.names.size(), unset);
+    return resume(ctx, program, 0);
+}
+
+// Runs the program from `pc` with whatever variables and pen the interpreter already has.
+bool resume(Interpreter& ctx, const Program& program, uint32_t pc) {
+    TRACE_SCOPE("execute");
+    vector<Tagged_Value> stack;
+    vector<Tagged_Value> locals;
+    vector<Frame>        call_stack;
+    uint32_t             frame_base = 0;
+    stack.reserve(64);
+    locals.reserve(64);
+
+    auto pop = [&]() {
+        auto value = stack.back();
+        stack.pop_back();
+        return value;
+    };
+    // Pops a value that has to be a number, reporting an error otherwise.
+    auto pop_number = [&](uint32_t pc, float& out) {
+        auto value = pop();
+        if (value.tag == Value_Tag::Number) {
+            out = value.number;
+            return true;
+        }
+        report_error(program.lines[pc], "Expected a number, but got '%s'.", value_to_string(program, value).c_str());
+        return false;
+    };
+    auto pop_integer = [&](uint32_t pc, float& out) {
+        if (!pop_number(pc, out)) return false;
+        if (out != truncf(out)) {
+            report_error(program.lines[pc], "Expected a whole number, but got '%g'.", out);
+            return false;
+        }
+        return true;
+    };
+    auto pop_bool = [&](uint32_t pc, bool& out) {
+        auto value = pop();
+        if (value.tag == Value_Tag::Boolean) {
+            out = value.boolean;
+            return true;
+        }
+        report_error(program.lines[pc], "Expected TRUE or FALSE, but got '%s'.",
+                     value_to_string(program, value).c_str());
+        return false;
+    };
+    auto add_assign = [&](uint32_t pc, Tagged_Value& variable, const char* name) {
+        float amount;
+        if (!pop_number(pc, amount)) return false;
+        if (variable.tag == Value_Tag::Unset) {
+            report_error(program.lines[pc], "Can't ADDASSIGN to '%s', no variable with that name exists.", name);
+            return false;
+        }
+        if (variable.tag != Value_Tag::Number) {
+            report_error(program.lines[pc], "Can't ADDASSIGN to '%s', it holds '%s' which isn't a number.", name,
+                         value_to_string(program, variable).c_str());
+            return false;
+        }
+        variable.number += amount;
+        return true;
+    };
+
+    for (;;) {
+        auto& instruction = program.code[pc];
+        TRACE_OP(instruction.op);
+        TRACE_STATEMENT(program.statement_commands[pc]);
+        using enum Op_Code;
+        switch (instruction.op) {
+            case Push_Constant:
+                stack.push_back(program.constants[instruction.operand]);
+                break;
+            case Load_Global: {
+                auto value = ctx.variables[instruction.operand];
+                if (value.tag == Value_Tag::Unset) {
+                    report_error(program.lines[pc], "Tried to get value of '%s', but no variable with that name exists.",
+                                 program.names[instruction.operand].c_str());
+                    return false;
+                }
+                stack.push_back(value);
+                break;
+            }
+            case Store_Global:
+                ctx.variables[instruction.operand] = pop();
+                break;
+            case Add_Assign_Global:
+                if (!add_assign(pc, ctx.variables[instruction.operand], program.names[instruction.operand].c_str())) {
+                    return false;
+                }
+                break;
+            // Locals are always bound by Enter, so they can never be unset.
+            case Load_Local:
+                stack.push_back(locals[frame_base + instruction.operand]);
+                break;
+            case Store_Local:
+                locals[frame_base + instruction.operand] = pop();
+                break;
+            case Add_Assign_Local:
+                if (!add_assign(pc, locals[frame_base + instruction.operand], "procedure argument")) return false;
+                break;
+
+            case Xcor:
+                stack.push_back(number_value((float)ctx.pen_state.pos[0]));
+                break;
+            case Ycor:
+                stack.push_back(number_value((float)ctx.pen_state.pos[1]));
+                break;
+            case Heading:
+                stack.push_back(number_value(ctx.pen_state.direction));
+                break;
+            case Color:
+                stack.push_back(number_value(ctx.pen_state.color));
+                break;
+
+            case Add:
+            case Subtract:
+            case Multiply:
+            case Divide:
+            case Gt:
+            case Lt: {
+                float rhs, lhs;
+                if (!pop_number(pc, rhs) || !pop_number(pc, lhs)) return false;
+                switch (instruction.op) {
+                    case Add:
+                        stack.push_back(number_value(lhs + rhs));
+                        break;
+                    case Subtract:
+                        stack.push_back(number_value(lhs - rhs));
+                        break;
+                    case Multiply:
+                        stack.push_back(number_value(lhs * rhs));
+                        break;
+                    case Divide:
+                        if (rhs == 0) {
+                            report_error(program.lines[pc], "Division by zero.");
+                            return false;
+                        }
+                        stack.push_back(number_value(lhs / rhs));
+                        break;
+                    case Gt:
+                        stack.push_back(bool_value(lhs > rhs));
+                        break;
+                    default:
+                        stack.push_back(bool_value(lhs < rhs));
+                        break;
+                }
+                break;
+            }
+            case Eq:
+            case Ne: {
+                auto rhs = pop();
+                auto lhs = pop();
+                stack.push_back(bool_value((lhs == rhs) == (instruction.op == Eq)));
+                break;
+            }
+            case And:
+            case Or: {
+                bool rhs, lhs;
+                if (!pop_bool(pc, rhs) || !pop_bool(pc, lhs)) return false;
+                stack.push_back(bool_value(instruction.op == And ? lhs && rhs : lhs || rhs));
+                break;
+            }
+
+            case Pen_Up:
+                ctx.pen_state.down = false;
+                break;
+            case Pen_Down:
+                ctx.pen_state.down = true;
+                break;
+            case Frame:
+                ctx.frames.push_back(display_list_size(ctx.display_list));
+                break;
+            case Forward:
+            case Back:
+            case Left:
+            case Right: {
+                float amount;
+                if (!pop_number(pc, amount)) return false;
+                move_pen(ctx, move_direction(instruction.op), amount);
+                break;
+            }
+            case Set_Pen_Color: {
+                float color;
+                if (!pop_integer(pc, color)) return false;
+                if (color < 0 || color > 15) {
+                    report_error(program.lines[pc], "Pen colors go from 0 to 15, but got '%g'.", color);
+                    return false;
+                }
+                ctx.pen_state.color = color;
+                break;
+            }
+            case Set_Pen_Size: {
+                float size;
+                if (!pop_integer(pc, size)) return false;
+                if (size < 1 || size > MAX_PEN_SIZE) {
+                    report_error(program.lines[pc], "Pen sizes go from 1 to %d, but got '%g'.", MAX_PEN_SIZE, size);
+                    return false;
+                }
+                ctx.pen_state.size = size;
+                break;
+            }
+            case Turn:
+            case Set_Heading: {
+                float degrees;
+                if (!pop_integer(pc, degrees)) return false;
+                set_direction(ctx.pen_state, instruction.op == Turn ? ctx.pen_state.direction + degrees : degrees);
+                break;
+            }
+            case Set_X:
+            case Set_Y: {
+                float position;
+                if (!pop_number(pc, position)) return false;
+                ctx.pen_state.pos[instruction.op == Set_X ? 0 : 1] = position;
+                break;
+            }
+
+            case Motion_Loop: {
+                auto& loop    = program.motion_loops[instruction.operand];
+                auto& counter = loop.local ? locals[frame_base + loop.counter] : ctx.variables[loop.counter];
+                if (counter.tag != Value_Tag::Number) break;
+                run_motion_loop(ctx, program, loop, counter.number);
+                pc += loop.skip;
+                continue;
+            }
+            case Statement:
+                if (ctx.checkpoints) take_checkpoint(ctx, program, instruction.operand);
+                break;
+            case Jump:
+                pc += instruction.operand;
+                continue;
+            case Jump_If_False: {
+                bool condition;
+                if (!pop_bool(pc, condition)) return false;
+                if (!condition) {
+                    pc += instruction.operand;
+                    continue;
+                }
+                break;
+            }
+            case Call:
+                call_stack.push_back({pc + 1, frame_base});
+                pc = instruction.operand;
+                continue;
+            case Enter: {
+                // The arguments were pushed in order, so they're already laid out like the frame.
+                frame_base = locals.size();
+                auto first = stack.end() - instruction.operand;
+                locals.insert(locals.end(), first, stack.end());
+                stack.erase(first, stack.end());
+                break;
+            }
+            case Return: {
+                auto frame = call_stack.back();
+                call_stack.pop_back();
+                locals.resize(frame_base);
+                frame_base = frame.base;
+                pc         = frame.return_pc;
+                continue;
+            }
+            case Halt:
+                return true;
+        }
+        pc++;
+    }
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include "compiler.hpp"
+#include "renderer.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct Pen_State {
+    bool    down;
+    double  pos[2]; // Double so a long run of small moves doesn't drift.
+    float   direction;
+    double  unit[2]; // Sine and cosine of direction, only ever changed along with it by set_direction.
+    uint8_t color;
+    uint8_t size;
+};
+
+enum class Direction { Forward, Back, Left, Right };
+
+// A global variable as it was at a checkpoint. Slots and word ids can change when a program is edited and
+// recompiled, so they're saved by name and text instead.
+struct Saved_Variable {
+    std::string  name;
+    Tagged_Value value;
+    std::string  word; // The text of value if it's a word.
+};
+
+// Everything needed to carry on from the start of a top-level statement as if the program had run up to it.
+struct Checkpoint {
+    uint32_t                    statement;
+    Pen_State                   pen_state;
+    std::vector<Saved_Variable> variables;
+    size_t                      segments; // The display list only ever grows, so it's restored by cutting it back.
+    size_t                      frames;   // Likewise Interpreter::frames.
+};
+
+// Everything one running logo program owns, so several programs can run side by side on different threads.
+struct Interpreter {
+    Pen_State pen_state;
+    // Indexed by the slots the compiler resolved every global variable name to.
+    std::vector<Tagged_Value> variables;
+    // What the program drew, in the coordinates of a canvas of this size. Rasterizing it is up to the caller.
+    Display_List display_list;
+    uint32_t     width;
+    uint32_t     height;
+    // How long the display list was at every FRAME, in the order they ran. Animations end a frame at each of these.
+    std::vector<size_t> frames;
+    // When set, a checkpoint is appended every so often at the start of a top-level statement.
+    std::vector<Checkpoint>* checkpoints;
+};
+
+void reset_interpreter(Interpreter& ctx, uint32_t width, uint32_t height);
+void set_direction(Pen_State& pen_state, float degrees);
+void move_pen(Interpreter& ctx, Direction direction, float amount);
+void move_pen_repeat(Interpreter& ctx, Direction direction, float amount, size_t count);
+bool run(Interpreter& ctx, const Program& program);
+bool resume(Interpreter& ctx, const Program& program, uint32_t pc);
+void restore_checkpoint(Interpreter& ctx, Program& program, const Checkpoint& checkpoint);
@@ -0,0 +1,231 @@
+#include "kernels.hpp"
+#include "trace.hpp"
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_KERNELS 1
+#endif
+
+/*
+    Scalar kernels, also used for the tails the vector kernels leave over.
+*/
+
+static void fill_span_scalar(uint32_t* pixels, size_t count, uint32_t color) {
+    for (size_t i = 0; i < count; i++) pixels[i] = color;
+}
+
+static void blend_span_scalar(uint32_t* pixels, size_t count, uint32_t color) {
+    uint32_t a = color >> 24, inv = 255 - a;
+    uint32_t r = (color & 0xff) * a, g = (color >> 8 & 0xff) * a, b = (color >> 16 & 0xff) * a;
+    for (size_t i = 0; i < count; i++) {
+        auto pixel = pixels[i];
+        pixels[i]  = div_255((pixel & 0xff) * inv + r) | div_255((pixel >> 8 & 0xff) * inv + g) << 8 |
+                    div_255((pixel >> 16 & 0xff) * inv + b) << 16 | (pixel & 0xff000000);
+    }
+}
+
+static void blend_coverage_span_scalar(uint32_t* pixels, const uint8_t* coverage, size_t count, uint32_t color) {
+    for (size_t i = 0; i < count; i++) blend_pixel(pixels + i, color, div_255((color >> 24) * coverage[i]));
+}
+
+#ifdef HAVE_X86_KERNELS
+/*
+    SSE4.1 kernels, four pixels at a time. Blending widens every channel to 16 bits, where c * (255 - a) + src * a
+    can't overflow, and divides by 255 with the same shifts as div_255.
+*/
+__attribute__((target("sse4.1"))) static inline __m128i div_255_sse4(__m128i x) {
+    return _mm_srli_epi16(_mm_add_epi16(x, _mm_add_epi16(_mm_set1_epi16(1), _mm_srli_epi16(x, 8))), 8);
+}
+
+__attribute__((target("sse4.1"))) static inline __m128i blend_channels_sse4(__m128i channels, __m128i inv,
+                                                                             __m128i src) {
+    return div_255_sse4(_mm_add_epi16(_mm_mullo_epi16(channels, inv), src));
+}
+
+// Like blend_channels_sse4, but with every pixel's alpha scaled by its own coverage, which is spread over its four
+// channels.
+__attribute__((target("sse4.1"))) static inline __m128i blend_coverage_channels_sse4(__m128i channels,
+                                                                                      __m128i coverage,
+                                                                                      __m128i alpha, __m128i color) {
+    auto a = div_255_sse4(_mm_mullo_epi16(coverage, alpha));
+    auto x = _mm_add_epi16(_mm_mullo_epi16(channels, _mm_sub_epi16(_mm_set1_epi16(255), a)), _mm_mullo_epi16(color, a));
+    return div_255_sse4(x);
+}
+
+__attribute__((target("sse4.1"))) static void fill_span_sse4(uint32_t* pixels, size_t count, uint32_t color) {
+    auto   value = _mm_set1_epi32(color);
+    size_t i     = 0;
+    for (; i + 4 <= count; i += 4) _mm_storeu_si128((__m128i*)(pixels + i), value);
+    fill_span_scalar(pixels + i, count - i, color);
+}
+
+__attribute__((target("sse4.1"))) static void blend_span_sse4(uint32_t* pixels, size_t count, uint32_t color) {
+    uint32_t a = color >> 24;
+    if (a == 0) return;
+    // Up to 255 * 255, which only fits in a short as its bit pattern. The vector code treats it as unsigned.
+    short r = (short)((color & 0xff) * a), g = (short)((color >> 8 & 0xff) * a), b = (short)((color >> 16 & 0xff) * a);
+    auto  src   = _mm_setr_epi16(r, g, b, 0, r, g, b, 0);
+    auto  inv   = _mm_set1_epi16(255 - a);
+    auto  zero  = _mm_setzero_si128();
+    auto  alpha = _mm_set1_epi32(0xff000000);
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        auto pixel = _mm_loadu_si128((__m128i*)(pixels + i));
+        auto lo    = blend_channels_sse4(_mm_unpacklo_epi8(pixel, zero), inv, src);
+        auto hi    = blend_channels_sse4(_mm_unpackhi_epi8(pixel, zero), inv, src);
+        auto out   = _mm_blendv_epi8(_mm_packus_epi16(lo, hi), pixel, alpha);
+        _mm_storeu_si128((__m128i*)(pixels + i), out);
+    }
+    blend_span_scalar(pixels + i, count - i, color);
+}
+
+__attribute__((target("sse4.1"))) static void blend_coverage_span_sse4(uint32_t* pixels, const uint8_t* coverage,
+                                                                        size_t count, uint32_t color) {
+    auto zero      = _mm_setzero_si128();
+    auto src       = _mm_unpacklo_epi8(_mm_set1_epi32(color), zero);
+    auto alpha     = _mm_set1_epi16(color >> 24);
+    auto keep      = _mm_set1_epi32(0xff000000);
+    // Spreads the coverage of pixels 0 and 1, or 2 and 3, over their channels as 16-bit lanes.
+    auto spread_lo = _mm_setr_epi8(0, -1, 0, -1, 0, -1, 0, -1, 1, -1, 1, -1, 1, -1, 1, -1);
+    auto spread_hi = _mm_setr_epi8(2, -1, 2, -1, 2, -1, 2, -1, 3, -1, 3, -1, 3, -1, 3, -1);
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        uint32_t packed;
+        memcpy(&packed, coverage + i, 4);
+        auto cover = _mm_cvtsi32_si128(packed);
+        auto pixel = _mm_loadu_si128((__m128i*)(pixels + i));
+        auto lo    = blend_coverage_channels_sse4(_mm_unpacklo_epi8(pixel, zero), _mm_shuffle_epi8(cover, spread_lo),
+                                                  alpha, src);
+        auto hi    = blend_coverage_channels_sse4(_mm_unpackhi_epi8(pixel, zero), _mm_shuffle_epi8(cover, spread_hi),
+                                                  alpha, src);
+        _mm_storeu_si128((__m128i*)(pixels + i), _mm_blendv_epi8(_mm_packus_epi16(lo, hi), pixel, keep));
+    }
+    blend_coverage_span_scalar(pixels + i, coverage + i, count - i, color);
+}
+
+/*
+    AVX2 kernels, the same thing eight pixels at a time. Unpacking and packing both work within 128-bit lanes, so the
+    pixels come back out in the order they went in.
+*/
+__attribute__((target("avx2"))) static inline __m256i div_255_avx2(__m256i x) {
+    return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_add_epi16(_mm256_set1_epi16(1), _mm256_srli_epi16(x, 8))), 8);
+}
+
+__attribute__((target("avx2"))) static inline __m256i blend_channels_avx2(__m256i channels, __m256i inv,
+                                                                           __m256i src) {
+    return div_255_avx2(_mm256_add_epi16(_mm256_mullo_epi16(channels, inv), src));
+}
+
+__attribute__((target("avx2"))) static inline __m256i blend_coverage_channels_avx2(__m256i channels,
+                                                                                    __m256i coverage, __m256i alpha,
+                                                                                    __m256i color) {
+    auto a = div_255_avx2(_mm256_mullo_epi16(coverage, alpha));
+    auto x = _mm256_add_epi16(_mm256_mullo_epi16(channels, _mm256_sub_epi16(_mm256_set1_epi16(255), a)),
+                              _mm256_mullo_epi16(color, a));
+    return div_255_avx2(x);
+}
+
+__attribute__((target("avx2"))) static void fill_span_avx2(uint32_t* pixels, size_t count, uint32_t color) {
+    auto   value = _mm256_set1_epi32(color);
+    size_t i     = 0;
+    for (; i + 8 <= count; i += 8) _mm256_storeu_si256((__m256i*)(pixels + i), value);
+    fill_span_scalar(pixels + i, count - i, color);
+}
+
+__attribute__((target("avx2"))) static void blend_span_avx2(uint32_t* pixels, size_t count, uint32_t color) {
+    uint32_t a = color >> 24;
+    if (a == 0) return;
+    short r = (short)((color & 0xff) * a), g = (short)((color >> 8 & 0xff) * a), b = (short)((color >> 16 & 0xff) * a);
+    auto  src   = _mm256_setr_epi16(r, g, b, 0, r, g, b, 0, r, g, b, 0, r, g, b, 0);
+    auto  inv   = _mm256_set1_epi16(255 - a);
+    auto  zero  = _mm256_setzero_si256();
+    auto  alpha = _mm256_set1_epi32(0xff000000);
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        auto pixel = _mm256_loadu_si256((__m256i*)(pixels + i));
+        auto lo    = blend_channels_avx2(_mm256_unpacklo_epi8(pixel, zero), inv, src);
+        auto hi    = blend_channels_avx2(_mm256_unpackhi_epi8(pixel, zero), inv, src);
+        auto out   = _mm256_blendv_epi8(_mm256_packus_epi16(lo, hi), pixel, alpha);
+        _mm256_storeu_si256((__m256i*)(pixels + i), out);
+    }
+    blend_span_sse4(pixels + i, count - i, color);
+}
+
+__attribute__((target("avx2"))) static void blend_coverage_span_avx2(uint32_t* pixels, const uint8_t* coverage,
+                                                                      size_t count, uint32_t color) {
+    auto zero = _mm256_setzero_si256();
+    auto src  = _mm256_unpacklo_epi8(_mm256_set1_epi32(color), zero);
+    auto alpha = _mm256_set1_epi16(color >> 24);
+    auto keep  = _mm256_set1_epi32(0xff000000);
+    // Both lanes get all eight coverage bytes. The low lane holds pixels 0-3 and the high lane pixels 4-7, and
+    // unpacking splits each lane into its first and second pair.
+    auto spread_lo = _mm256_setr_epi8(0, -1, 0, -1, 0, -1, 0, -1, 1, -1, 1, -1, 1, -1, 1, -1, 4, -1, 4, -1, 4, -1, 4,
+                                      -1, 5, -1, 5, -1, 5, -1, 5, -1);
+    auto spread_hi = _mm256_setr_epi8(2, -1, 2, -1, 2, -1, 2, -1, 3, -1, 3, -1, 3, -1, 3, -1, 6, -1, 6, -1, 6, -1, 6,
+                                      -1, 7, -1, 7, -1, 7, -1, 7, -1);
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        uint64_t packed;
+        memcpy(&packed, coverage + i, 8);
+        auto cover = _mm256_set1_epi64x(packed);
+        auto pixel = _mm256_loadu_si256((__m256i*)(pixels + i));
+        auto lo    = blend_coverage_channels_avx2(_mm256_unpacklo_epi8(pixel, zero),
+                                                  _mm256_shuffle_epi8(cover, spread_lo), alpha, src);
+        auto hi    = blend_coverage_channels_avx2(_mm256_unpackhi_epi8(pixel, zero),
+                                                  _mm256_shuffle_epi8(cover, spread_hi), alpha, src);
+        _mm256_storeu_si256((__m256i*)(pixels + i), _mm256_blendv_epi8(_mm256_packus_epi16(lo, hi), pixel, keep));
+    }
+    blend_coverage_span_sse4(pixels + i, coverage + i, count - i, color);
+}
+#endif
+
+/*
+    Runtime dispatch.
+*/
+typedef void (*Span_Kernel)(uint32_t* pixels, size_t count, uint32_t color);
+typedef void (*Coverage_Kernel)(uint32_t* pixels, const uint8_t* coverage, size_t count, uint32_t color);
+
+struct Span_Kernels {
+    Span_Kernel     fill;
+    Span_Kernel     blend;
+    Coverage_Kernel blend_coverage;
+    const char*     isa;
+};
+
+static Span_Kernels pick_kernels() {
+#ifdef HAVE_X86_KERNELS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return {fill_span_avx2, blend_span_avx2, blend_coverage_span_avx2, "avx2"};
+    if (__builtin_cpu_supports("sse4.1")) return {fill_span_sse4, blend_span_sse4, blend_coverage_span_sse4, "sse4.1"};
+#endif
+    return {fill_span_scalar, blend_span_scalar, blend_coverage_span_scalar, "scalar"};
+}
+
+static const Span_Kernels& kernels() {
+    static const Span_Kernels picked = pick_kernels();
+    return picked;
+}
+
+void fill_span(uint32_t* pixels, size_t count, uint32_t color) {
+    TRACE_COUNT(Pixels_Filled, count);
+    kernels().fill(pixels, count, color);
+}
+
+void blend_span(uint32_t* pixels, size_t count, uint32_t color) {
+    TRACE_COUNT(Pixels_Blended, count);
+    kernels().blend(pixels, count, color);
+}
+
+void blend_coverage_span(uint32_t* pixels, const uint8_t* coverage, size_t count, uint32_t color) {
+    TRACE_COUNT(Pixels_Blended, count);
+    kernels().blend_coverage(pixels, coverage, count, color);
+}
+
+const char* span_kernel_isa() {
+    return kernels().isa;
+}
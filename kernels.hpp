@@ -0,0 +1,29 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Exact x / 255 for anything up to 255 * 255, without the divide.
+inline uint32_t div_255(uint32_t x) {
+    return (x + 1 + (x >> 8)) >> 8;
+}
+
+// Blends the color part of `color` over one pixel with `alpha` out of 255, ignoring its own alpha. Inline for
+// anti-aliased hairlines, which only touch a pixel or two on each row. Red and blue are blended side by side in the
+// two halves of one word, each with div_255's own arithmetic, so it's exactly the same as blending them one by one.
+inline void blend_pixel(uint32_t* pixel, uint32_t color, uint32_t alpha) {
+    uint32_t inv = 255 - alpha, p = *pixel;
+    uint32_t red_blue = (p & 0x00ff00ff) * inv + (color & 0x00ff00ff) * alpha;
+    uint32_t green    = (p >> 8 & 0xff) * inv + (color >> 8 & 0xff) * alpha;
+    red_blue          = (red_blue + 0x00010001 + (red_blue >> 8 & 0x00ff00ff)) >> 8 & 0x00ff00ff;
+    *pixel            = red_blue | div_255(green) << 8 | (p & 0xff000000);
+}
+
+// Overwrites `count` pixels with `color`.
+void fill_span(uint32_t* pixels, size_t count, uint32_t color);
+// Blends `color` over `count` pixels exactly like olivec_blend_color does, keeping each pixel's own alpha.
+void blend_span(uint32_t* pixels, size_t count, uint32_t color);
+// Blends `color` over `count` pixels as if only coverage[i] out of 255 of pixel i were covered. Full coverage
+// blends exactly like blend_span, none leaves the pixel alone.
+void blend_coverage_span(uint32_t* pixels, const uint8_t* coverage, size_t count, uint32_t color);
+// Which instruction set the kernels ended up using, for reports.
+const char* span_kernel_isa();
@@ -0,0 +1,200 @@
+#include "lexer.hpp"
+#include <array>
+
+using namespace std;
+
+/*
+    Keyword lookup.
+
+    Every keyword and operator lives in a table indexed by a seeded FNV-1a hash of its lowercased text. The seed
+    is searched for at compile time so that no two keywords share a slot, which makes a lookup one hash, one
+    table load and one length-checked comparison, instead of a chain of string compares.
+*/
+struct Keyword {
+    string_view text;
+    Token_Type  type;
+};
+
+constexpr Keyword keywords[] = {
+    {"(", Token_Type::L_Paren},
+    {")", Token_Type::R_Paren},
+    {"{", Token_Type::L_Brace},
+    {"}", Token_Type::R_Brace},
+    {",", Token_Type::Comma},
+    {"-", Token_Type::Minus},
+    {"+", Token_Type::Plus},
+    {"/", Token_Type::Slash},
+    {"*", Token_Type::Star},
+
+    {"==", Token_Type::EQ},
+    {"eq", Token_Type::EQ},
+    {"!=", Token_Type::NE},
+    {"ne", Token_Type::NE},
+    {">", Token_Type::GT},
+    {"gt", Token_Type::GT},
+    {"<", Token_Type::LT},
+    {"lt", Token_Type::LT},
+    {"and", Token_Type::AND},
+    {"or", Token_Type::OR},
+    {"false", Token_Type::FALSE},
+    {"true", Token_Type::TRUE},
+    {"addassign", Token_Type::ADDASSIGN},
+
+    {"penup", Token_Type::PENUP},
+    {"pendown", Token_Type::PENDOWN},
+    {"forward", Token_Type::FORWARD},
+    {"back", Token_Type::BACK},
+    {"left", Token_Type::LEFT},
+    {"right", Token_Type::RIGHT},
+    {"setpencolor", Token_Type::SETPENCOLOR},
+    {"setpensize", Token_Type::SETPENSIZE},
+    {"turn", Token_Type::TURN},
+    {"setheading", Token_Type::SETHEADING},
+    {"setx", Token_Type::SETX},
+    {"sety", Token_Type::SETY},
+    {"frame", Token_Type::FRAME},
+
+    {"xcor", Token_Type::XCOR},
+    {"ycor", Token_Type::YCOR},
+    {"heading", Token_Type::HEADING},
+    {"color", Token_Type::COLOR},
+
+    {"to", Token_Type::Fn},
+    {"end", Token_Type::EndFn},
+    {"make", Token_Type::MAKE},
+    {"if", Token_Type::IF},
+    {"while", Token_Type::WHILE},
+};
+
+constexpr size_t KEYWORD_COUNT      = sizeof(keywords) / sizeof(keywords[0]);
+constexpr size_t KEYWORD_TABLE_SIZE = 256;
+
+constexpr char to_lower(char ch) {
+    return ch >= 'A' && ch <= 'Z' ? ch + ('a' - 'A') : ch;
+}
+
+constexpr uint32_t keyword_hash(string_view s, uint32_t seed) {
+    uint32_t hash = 2166136261u ^ seed;
+    for (char ch : s) {
+        hash ^= (uint8_t)to_lower(ch);
+        hash *= 16777619u;
+    }
+    return (hash ^ (hash >> 15)) & (KEYWORD_TABLE_SIZE - 1);
+}
+
+constexpr size_t longest_keyword() {
+    size_t longest = 0;
+    for (auto& keyword : keywords) longest = keyword.text.size() > longest ? keyword.text.size() : longest;
+    return longest;
+}
+
+constexpr uint32_t find_keyword_seed() {
+    for (uint32_t seed = 0;; seed++) {
+        array<bool, KEYWORD_TABLE_SIZE> used{};
+        bool                            collided = false;
+        for (auto& keyword : keywords) {
+            auto slot = keyword_hash(keyword.text, seed);
+            if (used[slot]) {
+                collided = true;
+                break;
+            }
+            used[slot] = true;
+        }
+        if (!collided) return seed;
+    }
+}
+
+constexpr uint32_t KEYWORD_SEED    = find_keyword_seed();
+constexpr size_t   LONGEST_KEYWORD = longest_keyword();
+
+// Slots hold an index into keywords plus one, zero means empty.
+constexpr array<uint8_t, KEYWORD_TABLE_SIZE> build_keyword_table() {
+    array<uint8_t, KEYWORD_TABLE_SIZE> table{};
+    for (size_t i = 0; i < KEYWORD_COUNT; i++) {
+        table[keyword_hash(keywords[i].text, KEYWORD_SEED)] = i + 1;
+    }
+    return table;
+}
+
+constexpr auto keyword_table = build_keyword_table();
+static_assert(KEYWORD_COUNT < 255, "keyword table slots are stored in a byte");
+
+Token_Type get_type_from_token(string_view s) {
+    if (s.size() > LONGEST_KEYWORD) return Token_Type::Identifier;
+    auto slot = keyword_table[keyword_hash(s, KEYWORD_SEED)];
+    if (slot == 0) return Token_Type::Identifier;
+
+    auto& keyword = keywords[slot - 1];
+    if (keyword.text.size() != s.size()) return Token_Type::Identifier;
+    for (size_t i = 0; i < s.size(); i++) {
+        if (to_lower(s[i]) != keyword.text[i]) return Token_Type::Identifier;
+    }
+    return keyword.type;
+}
+
+/*
+    Tokenizing.
+*/
+Lexer make_lexer(string_view source) {
+    return {source.data(), source.data() + source.size(), source.data(), 1};
+}
+
+static bool is_space(char ch) {
+    return ch == ' ' || ch == '\t' || ch == '\r' || ch == '\f' || ch == '\v';
+}
+
+// Brackets end a word so blocks can be written as [FORWARD "1] as well as on their own lines.
+static bool ends_word(char ch) {
+    return is_space(ch) || ch == '\n' || ch == '[' || ch == ']';
+}
+
+Token next_token(Lexer& lexer) {
+    for (;;) {
+        while (lexer.cursor < lexer.end && is_space(*lexer.cursor)) lexer.cursor++;
+
+        Token token;
+        token.line   = lexer.line;
+        token.column = lexer.cursor - lexer.line_start + 1;
+        if (lexer.cursor == lexer.end) {
+            token.type = Token_Type::EndOfFile;
+            token.text = {};
+            return token;
+        }
+
+        auto start = lexer.cursor;
+        switch (*start) {
+            case '\n':
+                lexer.cursor++;
+                lexer.line++;
+                lexer.line_start = lexer.cursor;
+                token.type       = Token_Type::Newline;
+                token.text       = {start, 1};
+                return token;
+            case '[':
+            case ']':
+                lexer.cursor++;
+                token.type = *start == '[' ? Token_Type::L_Bracket : Token_Type::R_Bracket;
+                token.text = {start, 1};
+                return token;
+            default:
+                break;
+        }
+
+        while (lexer.cursor < lexer.end && !ends_word(*lexer.cursor)) lexer.cursor++;
+        string_view word(start, lexer.cursor - start);
+
+        // Comments run to the end of the line and never reach the parser.
+        if (word.starts_with("//")) {
+            while (lexer.cursor < lexer.end && *lexer.cursor != '\n') lexer.cursor++;
+            continue;
+        }
+        if (word[0] == '"' || word[0] == ':') {
+            token.type = word[0] == '"' ? Token_Type::Word : Token_Type::VariableUse;
+            token.text = word.substr(1);
+            return token;
+        }
+        token.type = get_type_from_token(word);
+        token.text = word;
+        return token;
+    }
+}
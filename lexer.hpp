@@ -0,0 +1,100 @@
+#pragma once
+#include <cstdint>
+#include <string_view>
+
+enum class Token_Type {
+    // Single-character tokens.
+    L_Paren,
+    R_Paren,
+    L_Brace,
+    R_Brace,
+    L_Bracket,
+    R_Bracket,
+    Comma,
+    Minus,
+    Plus,
+    Slash,
+    Star,
+    Quote,
+
+    // Comparators / Control flow.
+    EQ,
+    NE,
+    GT,
+    LT,
+    AND,
+    OR,
+    FALSE,
+    TRUE,
+    ADDASSIGN,
+
+    // Turtle control builtins.
+    PENUP,
+    PENDOWN,
+    FORWARD,
+    BACK,
+    LEFT,
+    RIGHT,
+    SETPENCOLOR,
+    SETPENSIZE,
+    TURN,
+    SETHEADING,
+    SETX,
+    SETY,
+    FRAME,
+
+    // Queries.
+    XCOR,
+    YCOR,
+    HEADING,
+    COLOR,
+
+    // Function and variable identifier stuffs.
+    Identifier,
+    // we can determine when lexing whether the token
+    // denotes defining vs using a variable
+    VariableIdentifier,
+    VariableUse,
+    Fn,
+    EndFn,
+    Number,
+    // A raw value, i.e. "50 or "TRUE
+    Word,
+
+    // Control flow stuffs.
+    MAKE,
+    IF,
+    WHILE,
+
+    // Misc.
+    Comment,
+    Newline,
+    EndOfFile,
+    InvalidToken,
+};
+
+struct Token {
+    Token_Type type;
+    // Points straight into the source buffer. Values and variables have their " or : prefix stripped.
+    std::string_view text;
+    uint32_t         line;
+    uint32_t         column;
+};
+
+// Walks a source buffer one token at a time without copying it. The buffer must outlive every token.
+struct Lexer {
+    const char* cursor;
+    const char* end;
+    const char* line_start;
+    uint32_t    line;
+};
+
+// The token exactly as it appears in the source, prefix included.
+inline std::string_view source_text(const Token& token) {
+    bool prefixed = token.type == Token_Type::Word || token.type == Token_Type::VariableUse;
+    return prefixed ? std::string_view(token.text.data() - 1, token.text.size() + 1) : token.text;
+}
+
+Lexer      make_lexer(std::string_view source);
+Token      next_token(Lexer& lexer);
+Token_Type get_type_from_token(std::string_view s);
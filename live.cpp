@@ -0,0 +1,152 @@
+#include "live.hpp"
+#include "trace.hpp"
+#include "util.hpp"
+#include <algorithm>
+#include <chrono>
+
+using namespace std;
+
+void live_start(Live_Session& session, uint32_t width, uint32_t height, Thread_Pool* pool) {
+    session.program.reset();
+    session.ran = false;
+    reset_interpreter(session.ctx, width, height);
+    session.checkpoints.clear();
+    session.tile_hashes.clear();
+    session.pixels.assign((size_t)width * height, 0);
+    session.pool = pool;
+}
+
+// Where the main program ends and the procedure bodies start, see generate_bytecode.
+static int32_t halt_address(const Program& program) {
+    auto halt = find_if(program.code.begin(), program.code.end(),
+                        [](Instruction instruction) { return instruction.op == Op_Code::Halt; });
+    return halt - program.code.begin();
+}
+
+// Whether two instructions do the same thing. Constants, globals and procedures can sit at different indices in two
+// compilations of nearly the same source, so those are compared by what they refer to.
+static bool same_instruction(const Program& a, Instruction x, const Program& b, Instruction y) {
+    if (x.op != y.op) return false;
+    switch (x.op) {
+        case Op_Code::Push_Constant: {
+            auto p = a.constants[x.operand], q = b.constants[y.operand];
+            if (p.tag == Value_Tag::Word && q.tag == Value_Tag::Word) return a.words[p.word] == b.words[q.word];
+            return p == q;
+        }
+        case Op_Code::Load_Global:
+        case Op_Code::Store_Global:
+        case Op_Code::Add_Assign_Global:
+            return a.names[x.operand] == b.names[y.operand];
+        case Op_Code::Call:
+            return x.operand - halt_address(a) == y.operand - halt_address(b);
+        default:
+            return x.operand == y.operand;
+    }
+}
+
+static bool same_code(const Program& a, int32_t a_start, int32_t a_end, const Program& b, int32_t b_start,
+                      int32_t b_end) {
+    if (a_end - a_start != b_end - b_start) return false;
+    for (int32_t i = 0; i < a_end - a_start; i++) {
+        if (!same_instruction(a, a.code[a_start + i], b, b.code[b_start + i])) return false;
+    }
+    return true;
+}
+
+// The first top-level statement of `b` that might not do what the same statement of `a` did. Returns the number of
+// statements in `b` if `b` is `a`, or `a` with statements cut off the end. Any change to a procedure could change every
+// statement that calls it, so that starts over from the top.
+static uint32_t first_changed_statement(const Program& a, const Program& b) {
+    auto a_halt = halt_address(a), b_halt = halt_address(b);
+    if (!same_code(a, a_halt, a.code.size(), b, b_halt, b.code.size())) return 0;
+
+    auto a_count = (uint32_t)a.statement_starts.size(), b_count = (uint32_t)b.statement_starts.size();
+    for (uint32_t i = 0; i < min(a_count, b_count); i++) {
+        auto a_end = i + 1 < a_count ? (int32_t)a.statement_starts[i + 1] : a_halt;
+        auto b_end = i + 1 < b_count ? (int32_t)b.statement_starts[i + 1] : b_halt;
+        if (!same_code(a, a.statement_starts[i], a_end, b, b.statement_starts[i], b_end)) return i;
+    }
+    return min(a_count, b_count);
+}
+
+// Runs `program` from the nearest checkpoint at or before statement `first`, or from the top if there isn't one.
+// Returns the statement it carried on from. A checkpoint right after the last statement, left over from before
+// statements were cut off the end, just halts, which still cuts the display list back.
+static uint32_t execute_from(Live_Session& session, Program& program, uint32_t first, bool& success) {
+    auto& checkpoints = session.checkpoints;
+    auto  statements  = (uint32_t)program.statement_starts.size();
+    while (!checkpoints.empty() && checkpoints.back().statement > min(first, statements)) checkpoints.pop_back();
+
+    if (checkpoints.empty()) {
+        reset_interpreter(session.ctx, session.ctx.width, session.ctx.height);
+        session.ctx.checkpoints = &checkpoints;
+        success                 = run(session.ctx, program);
+        return 0;
+    }
+    // The checkpoint stays, it's just as valid for the new program.
+    auto& checkpoint = checkpoints.back();
+    restore_checkpoint(session.ctx, program, checkpoint);
+    session.ctx.checkpoints = &checkpoints;
+    auto address = checkpoint.statement < statements ? program.statement_starts[checkpoint.statement]
+                                                     : (uint32_t)halt_address(program);
+    success      = resume(session.ctx, program, address);
+    return checkpoint.statement;
+}
+
+// Compiles `source`, executes as little of it as the last update allows, redraws the tiles that changed and writes
+// the image to `output`. If anything fails the canvas is left as it was.
+bool live_update(Live_Session& session, string_view source, const char* output, const Encode_Options& encode,
+                 Live_Update& update) {
+    TRACE_SCOPE("live update");
+    update = {0, 0, 0, 0, {0, 0, 0, 0}};
+
+    auto start   = chrono::steady_clock::now();
+    auto program = compile(source);
+    update.timing.compile_ms = elapsed_ms(start);
+    if (!program) return false;
+
+    update.statements = program->statement_starts.size();
+    auto first        = session.program ? first_changed_statement(*session.program, *program) : 0;
+    update.resumed_at = first;
+    update.tiles      = session.tile_hashes.size();
+    // Only the same program can skip everything. One with statements cut off the end still has segments to take off.
+    if (session.ran && first == update.statements && session.program->statement_starts.size() == update.statements) {
+        return true;
+    }
+
+    start             = chrono::steady_clock::now();
+    session.program   = std::move(program);
+    bool success      = false;
+    update.resumed_at = execute_from(session, *session.program, first, success);
+    session.ran       = success;
+    update.timing.execute_ms = elapsed_ms(start);
+    if (!success) return false;
+
+    start       = chrono::steady_clock::now();
+    auto& ctx   = session.ctx;
+    auto& plan  = session.plan;
+    auto  fresh = session.tile_hashes.empty();
+    plan_raster(plan, ctx.width, ctx.height, ctx.display_list, 1);
+    session.tile_hashes.resize(plan.bins.size());
+
+    Olivec_Canvas canvas = {.pixels = session.pixels.data(), .width = ctx.width, .height = ctx.height,
+                            .stride = ctx.width};
+    vector<uint32_t> dirty;
+    for (uint32_t tile = 0; tile < plan.bins.size(); tile++) {
+        auto hash = tile_hash(plan, tile);
+        if (!fresh && hash == session.tile_hashes[tile]) continue;
+        session.tile_hashes[tile] = hash;
+        dirty.push_back(tile);
+    }
+    redraw_tiles(canvas, plan, dirty, session.pool);
+    update.dirty_tiles      = dirty.size();
+    update.tiles            = plan.bins.size();
+    update.timing.raster_ms = elapsed_ms(start);
+
+    if (output) {
+        start = chrono::steady_clock::now();
+        if (!write_image(output, canvas, encode)) return false;
+        update.timing.encode_ms = elapsed_ms(start);
+    }
+    return true;
+}
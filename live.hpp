@@ -0,0 +1,37 @@
+#pragma once
+#include "batch.hpp"
+#include "compiler.hpp"
+#include "encoder.hpp"
+#include "interpreter.hpp"
+#include "renderer.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+// One program being edited and rendered over and over. After the first full run, an update only executes the program
+// again from the nearest checkpoint before the first top-level statement that changed, and only redraws the tiles
+// whose lines changed.
+struct Live_Session {
+    std::optional<Program>  program; // What ctx last ran.
+    bool                    ran;     // Whether that run finished without an error.
+    Interpreter             ctx;
+    std::vector<Checkpoint> checkpoints;
+    Raster_Plan             plan;
+    std::vector<uint64_t>   tile_hashes; // Of what's on the canvas now, empty until something has been drawn.
+    std::vector<uint32_t>   pixels;
+    Thread_Pool*            pool;
+};
+
+struct Live_Update {
+    uint32_t      resumed_at; // The top-level statement execution carried on from.
+    uint32_t      statements;
+    size_t        dirty_tiles;
+    size_t        tiles;
+    Render_Timing timing;
+};
+
+void live_start(Live_Session& session, uint32_t width, uint32_t height, Thread_Pool* pool);
+bool live_update(Live_Session& session, std::string_view source, const char* output, const Encode_Options& encode,
+                 Live_Update& update);
@@ -4,399 +4,332 @@
 #include <optional>
 #include <stdlib.h>
 
-#define OLIVEC_IMPLEMENTATION
-#include "third_party/olive.h"
-
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-#include "third_party/stb_image_write.h"
-
+#include "animation.hpp"
+#include "batch.hpp"
+#include "bench.hpp"
+#include "compiler.hpp"
+#include "encoder.hpp"
+#include "interpreter.hpp"
+#include "live.hpp"
+#include "trace.hpp"
 #include "util.hpp"
+#include <charconv>
+#include <csignal>
 #include <cstdio>
-#include <map>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
 #include <string>
-#include <variant>
+#include <thread>
 #include <vector>
 
 using namespace std;
-typedef variant<float, bool, string> Logo_Value;
 
 constexpr uint16_t IMG_WIDTH  = 1000;
 constexpr uint16_t IMG_HEIGHT = 1000;
-Olivec_Canvas      canvas;
-
-enum class Token_Type {
-    // Single-character tokens.
-    L_Paren,
-    R_Paren,
-    L_Brace,
-    R_Brace,
-    Comma,
-    Minus,
-    Plus,
-    Slash,
-    Star,
-    Quote,
-
-    // Comparators / Control flow.
-    EQ,
-    NE,
-    GT,
-    LT,
-    AND,
-    OR,
-    FALSE,
-    TRUE,
-    ADDASSIGN,
-
-    // Turtle control builtins.
-    PENUP,
-    PENDOWN,
-    FORWARD,
-    BACK,
-    LEFT,
-    RIGHT,
-    SETPENCOLOR,
-    TURN,
-    SETHEADING,
-    SETX,
-    SETY,
-
-    // Queries.
-    XCOR,
-    YCOR,
-    HEADING,
-    COLOR,
-
-    // Function and variable identifier stuffs.
-    Identifier,
-    // we can determine when lexing whether the token
-    // denotes defining vs using a variable
-    VariableIdentifier,
-    VariableUse,
-    Fn,
-    EndFn,
-    Number,
 
-    // Control flow stuffs.
-    MAKE,
-    IF,
-    WHILE,
-
-    // Misc.
-    Comment,
-    InvalidToken,
-};
-
-enum class Statement_Type {
-    Function_Decleration,
-    Variable_Decleration,
-    Pen_Movement,
-    Pen_Color,
-    Add_Assign,
-    If,
-    While,
-    Comment,
-    Erroneous
-};
-
-struct Pen_State {
-    bool  down;
-    float pos[2];
-    float direction;
-};
-
-enum class Direction { Forward, Back, Left, Right };
+static void print_usage() {
+    fprintf(stderr, "usage: app [options] [program.lg] [output.png|.ppm|.pam]\n"
+                    "       app [options] --batch <directory|manifest> [--out <directory>] [--jobs <n>]\n"
+                    "           [--scales <s,...>] [--format png|ppm|pam]\n"
+                    "       app [options] --watch <program.lg> <output.png|.ppm|.pam>\n"
+                    "       app [options] --animate <program.lg> <directory|output.y4m|-> [--every <n>] [--fps <n>]\n"
+                    "       app --dump-ir [program.lg]\n"
+                    "       app [options] --bench <directory> [--out <results.json>] [--warmup <n>] [--reps <n>]\n"
+                    "           [--stress yes|no]\n"
+                    "options: --level <0-9> --filter none|sub|up|average|paeth|adaptive --band-rows <n>\n"
+                    "         --trace <trace.json> (builds made with TRACE=1 ./build.sh)\n");
+}
 
-vector<std::string>  split(string s, char seperator);
-Token_Type           get_type_from_token(std::string s);
-optional<Logo_Value> get_variable_value(string name, Logo_Value initial_value);
-vector<Token_Type>   parse_out_tokens(vector<string> string_tokens);
-Statement_Type       parse_statement_type(Token_Type token);
-void                 parse_pen_movement(vector<Token_Type> tokens, std::vector<std::string> string_tokens);
-void                 parse_pen_color_change(vector<Token_Type> tokens);
-void                 parse_variable_decleration(vector<Token_Type> tokens);
-void                 parse_function_decleration(vector<Token_Type> tokens);
-void                 parse_add_assign(vector<Token_Type> tokens);
+static const char* trace_path = nullptr;
 
-void draw_line(float start[2], float end[2]);
+// Every mode ends in exit(), so the trace is written on the way out, once every traced thread has been joined.
+static void write_trace() {
+    if (!trace_write_chrome(trace_path)) fprintf(stderr, "ERROR! Couldn't write the trace to '%s'.\n", trace_path);
+    trace_print_summary(stderr);
+}
 
-Pen_State               pen_state;
-map<string, Logo_Value> variables;
+[[noreturn]] static void bad_argument(const char* what, const char* value) {
+    fprintf(stderr, "ERROR! '%s' isn't a valid %s.\n", value, what);
+    exit(-1);
+}
 
-void parse_line(string line) {
-    auto string_tokens  = split(line, ' ');
-    auto tokens         = parse_out_tokens(string_tokens);
-    auto statement_type = parse_statement_type(tokens[0]);
-    using enum Statement_Type;
-    switch (statement_type) {
-        case Pen_Movement:
-            return parse_pen_movement(tokens, string_tokens);
-        case Pen_Color:
-            return parse_pen_color_change(tokens);
-        case Variable_Decleration:
-            return parse_variable_decleration(tokens);
-        case Add_Assign:
-            return parse_add_assign(tokens);
-        case Comment:
-            return;
-        case Erroneous:
-            puts("This file seems messed up!!! Goodbye (:");
-            exit(-1);
-        default:
-            puts("Trying to parse a type of statement we don't know how to handle yet... Goodbye (:");
+// Parses a comma separated list of scales like "1,2,0.5".
+static bool parse_scales(const char* text, vector<float>& scales) {
+    scales.clear();
+    auto end = text + strlen(text);
+    while (text < end) {
+        float scale;
+        auto  result = from_chars(text, end, scale);
+        if (result.ec != errc() || scale <= 0 || (result.ptr != end && *result.ptr != ',')) return false;
+        scales.push_back(scale);
+        text = result.ptr + (result.ptr != end);
     }
+    return !scales.empty();
 }
 
-vector<string> split(string s, char seperator) {
-    vector<string> words;
-    string         word;
-    for (char ch : s) {
-        if (ch == seperator) {
-            if (word.length() > 0) {
-                words.push_back(word);
-                word.clear();
-            }
-        } else {
-            word += ch;
-        }
-    }
-    if (word.length() > 0) {
-        words.push_back(word);
-    }
-    return words;
+static bool parse_count(const char* text, size_t& count) {
+    auto end    = text + strlen(text);
+    auto result = from_chars(text, end, count);
+    return result.ec == errc() && result.ptr == end;
 }
 
-Token_Type get_type_from_token(string s) {
-    string tmp = "";
-    // Too lazy to change the if statements :)) so we have this hack.
-    for (auto ch : s) {
-        tmp += tolower(ch);
+// Prints the program's bytecode as compiled straight from the source, then again after optimize().
+static bool dump_ir(const char* path) {
+    auto file = map_file(path);
+    if (!file) {
+        fprintf(stderr, "ERROR! Couldn't open '%s'.\n", path);
+        return false;
     }
-    s = tmp;
-    if (s == "(") return Token_Type::L_Paren;
-    if (s == ")") return Token_Type::R_Paren;
-    if (s == "{") return Token_Type::L_Brace;
-    if (s == "}") return Token_Type::R_Brace;
-    if (s == ",") return Token_Type::Comma;
-    if (s == "-") return Token_Type::Minus;
-    if (s == "+") return Token_Type::Plus;
-    if (s == "/") return Token_Type::Slash;
-    if (s == "*") return Token_Type::Star;
-    if (s == "\"") return Token_Type::Quote;
-
-    if (s == "==") return Token_Type::EQ;
-    if (s == "!=") return Token_Type::NE;
-    if (s == ">") return Token_Type::GT;
-    if (s == "<") return Token_Type::LT;
-    if (s == "and") return Token_Type::AND;
-    if (s == "or") return Token_Type::OR;
-    if (s == "false") return Token_Type::FALSE;
-    if (s == "true") return Token_Type::TRUE;
-    if (s == "addassign") return Token_Type::ADDASSIGN;
-
-    if (s == "penup") return Token_Type::PENUP;
-    if (s == "pendown") return Token_Type::PENDOWN;
-    if (s == "forward") return Token_Type::FORWARD;
-    if (s == "back") return Token_Type::BACK;
-    if (s == "left") return Token_Type::LEFT;
-    if (s == "right") return Token_Type::RIGHT;
-    if (s == "setpencolor") return Token_Type::SETPENCOLOR;
-    if (s == "turn") return Token_Type::TURN;
-    if (s == "setheading") return Token_Type::SETHEADING;
-    if (s == "setx") return Token_Type::SETX;
-    if (s == "sety") return Token_Type::SETY;
-
-    if (s == "xcor") return Token_Type::XCOR;
-    if (s == "ycor") return Token_Type::YCOR;
-    if (s == "heading") return Token_Type::HEADING;
-    if (s == "color") return Token_Type::COLOR;
-
-    if (s == "to") return Token_Type::Fn;
-    if (s == "end") return Token_Type::EndFn;
-    if (s == "make") return Token_Type::MAKE;
-    if (s == "if") return Token_Type::IF;
-    if (s == "while") return Token_Type::WHILE;
+    auto ast = parse_program(file->contents());
+    unmap_file(*file);
+    if (!ast) return false;
+
+    auto before = generate_bytecode(*ast);
+    optimize(*ast);
+    auto after = generate_bytecode(*ast);
+    printf("== %s before optimizing: %zu instructions\n", path, before.code.size());
+    dump_program(stdout, before);
+    printf("\n== %s after optimizing: %zu instructions, %zu closed form loops\n", path, after.code.size(),
+           after.motion_loops.size());
+    dump_program(stdout, after);
+    return true;
+}
 
-    if (s == "//") return Token_Type::Comment;
+static volatile sig_atomic_t stop_watching = 0;
 
-    return Token_Type::InvalidToken;
+// The first Ctrl-C lets watch finish the update it's in and exit normally, so exit handlers like the one writing the
+// trace still run. A second one kills it as usual, in case that update never finishes.
+static void interrupt_watch(int) {
+    stop_watching = 1;
+    signal(SIGINT, SIG_DFL);
 }
 
-vector<Token_Type> parse_out_tokens(vector<string> string_tokens) {
-    vector<Token_Type> tokens;
-    for (auto string_token : string_tokens) {
-        tokens.push_back(get_type_from_token(string_token));
-    }
-    return tokens;
-}
+// Renders the program to `output` every time it's saved, until Ctrl-C. Small edits only re-execute the program from
+// just before what changed and only redraw the tiles that changed.
+[[noreturn]] static void watch(const char* path, const char* output, const Encode_Options& encode) {
+    signal(SIGINT, interrupt_watch);
+    Thread_Pool pool;
+    pool_start(pool, thread::hardware_concurrency());
+    auto options = encode;
+    options.pool = &pool;
+
+    Live_Session session;
+    live_start(session, IMG_WIDTH, IMG_HEIGHT, &pool);
+    filesystem::file_time_type last_write;
+    while (!stop_watching) {
+        error_code error;
+        auto       write_time = filesystem::last_write_time(path, error);
+        if (error || write_time == last_write) {
+            this_thread::sleep_for(chrono::milliseconds(50));
+            continue;
+        }
+        last_write = write_time;
 
-Statement_Type parse_statement_type(Token_Type token) {
-    using enum Token_Type;
-    switch (token) {
-        case PENUP:
-        case PENDOWN:
-        case FORWARD:
-        case BACK:
-        case LEFT:
-        case RIGHT:
-        case TURN:
-        case SETHEADING:
-        case SETX:
-        case SETY:
-            return Statement_Type::Pen_Movement;
-        case SETPENCOLOR:
-            return Statement_Type::Pen_Color;
-        case ADDASSIGN:
-            return Statement_Type::Add_Assign;
-        case Fn:
-            return Statement_Type::Function_Decleration;
-        case MAKE:
-            return Statement_Type::Variable_Decleration;
-        case IF:
-            return Statement_Type::If;
-        case WHILE:
-            return Statement_Type::While;
-        case Comment:
-            return Statement_Type::Comment;
-        case InvalidToken:
-            return Statement_Type::Erroneous;
-        default:
-            return Statement_Type::Erroneous;
+        auto file = map_file(path);
+        if (!file) {
+            fprintf(stderr, "ERROR! Couldn't open '%s'.\n", path);
+            continue;
+        }
+        Live_Update update;
+        auto        success = live_update(session, file->contents(), output, options, update);
+        unmap_file(*file);
+        auto& timing = update.timing;
+        printf("%s: from statement %u/%u, %zu/%zu tiles redrawn, compile %.3f ms, execute %.3f ms, raster %.3f ms, "
+               "encode %.3f ms\n",
+               success ? "ok" : "FAILED", update.resumed_at, update.statements, update.dirty_tiles, update.tiles,
+               timing.compile_ms, timing.execute_ms, timing.raster_ms, timing.encode_ms);
+        fflush(stdout);
     }
+    pool_stop(pool);
+    exit(0);
 }
 
-// This function assumes you've checked the variables map once before, and passed in the value.
-optional<Logo_Value> get_variable_value(string name, Logo_Value initial_value) {
-    if (holds_alternative<string>(initial_value)) {
-        auto s = get<string>(initial_value);
-        if (s[0] == ':') {
-            // check if value is in the map
-            if (variables.contains(s)) {
-                return get_variable_value(s, variables[s]);
-            } else {
-                return nullopt;
+int main(int argc, char** argv) {
+    Batch_Options options = {
+        .input      = "",
+        .output_dir = "batch_output",
+        .jobs       = max(1u, thread::hardware_concurrency()),
+        .width      = IMG_WIDTH,
+        .height     = IMG_HEIGHT,
+        .scales     = {1},
+        .encode =
+            {
+                .format    = Image_Format::Png,
+                .level     = 6,
+                .filter    = Png_Filter::Paeth,
+                .band_rows = 128,
+                .pool      = nullptr,
+            },
+    };
+    Bench_Options bench_options = {
+        .input       = "",
+        .output      = "bench.json",
+        .warmup      = 2,
+        .repetitions = 10,
+        .stress      = true,
+        .width       = IMG_WIDTH,
+        .height      = IMG_HEIGHT,
+        .encode      = {},
+    };
+    Animation_Options animation_options = {
+        .input  = "",
+        .output = "",
+        .format = Animation_Format::Png_Sequence,
+        .every  = 0,
+        .fps    = 30,
+        .width  = IMG_WIDTH,
+        .height = IMG_HEIGHT,
+        .encode = {},
+    };
+    bool                batch         = false;
+    bool                bench         = false;
+    bool                out_picked    = false;
+    bool                format_picked = false;
+    const char*         watched       = nullptr;
+    const char*         animated      = nullptr;
+    bool                dump          = false;
+    vector<const char*> positional;
+
+    for (int i = 1; i < argc; i++) {
+        auto flag  = argv[i];
+        auto value = i + 1 < argc ? argv[i + 1] : nullptr;
+        // A lone "-" is stdout, not a flag.
+        if (flag[0] != '-' || flag[1] == '\0') {
+            positional.push_back(flag);
+            continue;
+        }
+        if (strcmp(flag, "--dump-ir") == 0) {
+            dump = true;
+            continue;
+        }
+        if (!value) {
+            print_usage();
+            exit(-1);
+        }
+        i++;
+        if (strcmp(flag, "--batch") == 0) {
+            batch         = true;
+            options.input = value;
+        } else if (strcmp(flag, "--watch") == 0) {
+            watched = value;
+        } else if (strcmp(flag, "--animate") == 0) {
+            animated = value;
+        } else if (strcmp(flag, "--every") == 0) {
+            if (!parse_count(value, animation_options.every)) bad_argument("number of segments", value);
+        } else if (strcmp(flag, "--fps") == 0) {
+            size_t fps;
+            if (!parse_count(value, fps) || fps == 0 || fps > UINT32_MAX) bad_argument("frame rate", value);
+            animation_options.fps = fps;
+        } else if (strcmp(flag, "--bench") == 0) {
+            bench               = true;
+            bench_options.input = value;
+        } else if (strcmp(flag, "--warmup") == 0) {
+            if (!parse_count(value, bench_options.warmup)) bad_argument("number of runs", value);
+        } else if (strcmp(flag, "--reps") == 0) {
+            if (!parse_count(value, bench_options.repetitions) || bench_options.repetitions == 0) {
+                bad_argument("number of runs", value);
             }
+        } else if (strcmp(flag, "--stress") == 0) {
+            if (strcmp(value, "yes") != 0 && strcmp(value, "no") != 0) bad_argument("yes or no", value);
+            bench_options.stress = strcmp(value, "yes") == 0;
+        } else if (strcmp(flag, "--out") == 0) {
+            options.output_dir = value;
+            out_picked         = true;
+        } else if (strcmp(flag, "--jobs") == 0) {
+            if (!parse_count(value, options.jobs) || options.jobs == 0) bad_argument("number of jobs", value);
+        } else if (strcmp(flag, "--scales") == 0) {
+            if (!parse_scales(value, options.scales)) bad_argument("list of scales", value);
+        } else if (strcmp(flag, "--format") == 0) {
+            auto format = parse_image_format(value);
+            if (!format) bad_argument("image format", value);
+            options.encode.format = *format;
+            format_picked         = true;
+        } else if (strcmp(flag, "--level") == 0) {
+            size_t level;
+            if (!parse_count(value, level) || level > 9) bad_argument("compression level", value);
+            options.encode.level = level;
+        } else if (strcmp(flag, "--filter") == 0) {
+            auto filter = parse_png_filter(value);
+            if (!filter) bad_argument("PNG filter", value);
+            options.encode.filter = *filter;
+        } else if (strcmp(flag, "--band-rows") == 0) {
+            if (!parse_count(value, options.encode.band_rows)) bad_argument("number of rows", value);
+        } else if (strcmp(flag, "--trace") == 0) {
+            trace_path = value;
         } else {
-            // variables cannot be set to normal strings.
-            return nullopt;
+            print_usage();
+            exit(-1);
         }
-    } else {
-        return initial_value;
     }
-}
 
-// This will draw a line if the pen is down. This is the only
-// function that draws a line.
-void move_pen(Direction direction, float amount) {
-    auto  angle_radians = degree_to_radians(pen_state.direction);
-    float new_pos[2];
-    switch (direction) {
-        case Direction::Forward:
-            new_pos[0] += cos(angle_radians) * amount;
-            new_pos[1] += sin(angle_radians) * amount;
-        case Direction::Back:
-            new_pos[0] -= cos(angle_radians) * amount;
-            new_pos[1] -= sin(angle_radians) * amount;
-        case Direction::Left:
-            new_pos[0] += cos(angle_radians + numbers::pi * 2) * amount;
-            new_pos[1] += sin(angle_radians + numbers::pi * 2) * amount;
-        case Direction::Right:
-            new_pos[0] += cos(angle_radians - numbers::pi * 2) * amount;
-            new_pos[1] += sin(angle_radians - numbers::pi * 2) * amount;
+    if (trace_path) {
+        if (!TRACE_ENABLED) {
+            fprintf(stderr, "ERROR! This build can't trace, rebuild it with TRACE=1 ./build.sh.\n");
+            exit(-1);
+        }
+        atexit(write_trace);
     }
-
-    if (pen_state.down) {
-        cout << "drawing line from " << pen_state.pos << " - " << new_pos << endl;
-        draw_line(pen_state.pos, new_pos);
+    if (bench) {
+        if (!positional.empty()) {
+            print_usage();
+            exit(-1);
+        }
+        if (out_picked) bench_options.output = options.output_dir;
+        bench_options.encode = options.encode;
+        exit(run_bench(bench_options));
     }
-    pen_state.pos[0] = new_pos[0];
-    pen_state.pos[1] = new_pos[1];
-}
-
-void parse_pen_movement(vector<Token_Type> tokens, vector<string> string_tokens) {
-    float amount;
-    using enum Token_Type;
-    switch (tokens[0]) {
-        case PENDOWN:
-            pen_state.down = true;
-            return;
-        case PENUP:
-            pen_state.down = false;
-            return;
-        default:
-            // Indicates wheter amount comes from a variable.
-            if (string_tokens[1][0] == ':') {
-                auto variable_name = string_tokens[1].substr(1);
-                if (variables.contains(variable_name)) {
-                    auto res = get_variable_value(variable_name, variables[variable_name]);
-                    if (res) {
-                        amount = get<float>(*res);
-                    } else {
-                        printf("ERROR! Tried to get value of '%s', but no variable with name '%s' exists.",
-                               variable_name.c_str(), variable_name.c_str());
-                    }
-                } else {
-                    printf("ERROR! Tried to get value of '%s', but no variable with name '%s' exists.",
-                           variable_name.c_str(), variable_name.c_str());
-                    exit(-1);
-                }
-            } else {
-                cout << "trying to convert to float: " << string_tokens[1];
-                amount = stof(string_tokens[1].substr(1));
-                cout << endl << "found amount: " << amount << endl;
-            }
+    if (batch) {
+        if (!positional.empty()) {
+            print_usage();
+            exit(-1);
+        }
+        exit(run_batch(options));
     }
-    switch (tokens[0]) {
-        case FORWARD:
-            move_pen(Direction::Forward, amount);
-        case BACK:
-            move_pen(Direction::Back, amount);
-        case LEFT:
-            move_pen(Direction::Left, amount);
-        case RIGHT:
-            move_pen(Direction::Right, amount);
-        case TURN:
-            pen_state.direction += amount;
-        case SETHEADING:
-            pen_state.direction = amount;
-            return;
-        case SETX:
-            pen_state.pos[0] = amount;
-            return;
-        case SETY:
-            pen_state.pos[1] = amount;
-            return;
-        default:
-            cout << "you done fucked up!!!" << endl;
+    if (animated) {
+        if (positional.size() != 1) {
+            print_usage();
             exit(-1);
+        }
+        // Anything that isn't a Y4M stream is a directory to put a PNG sequence in.
+        auto extension           = filesystem::path(positional[0]).extension().string();
+        animation_options.input  = animated;
+        animation_options.output = positional[0];
+        animation_options.format = strcmp(positional[0], "-") == 0 || extension == ".y4m"
+                                       ? Animation_Format::Y4m
+                                       : Animation_Format::Png_Sequence;
+        animation_options.encode = options.encode;
+        exit(run_animation(animation_options));
     }
-}
-
-void parse_pen_color_change(std::vector<Token_Type> tokens) {}
-void parse_variable_decleration(std::vector<Token_Type> tokens) {}
-void parse_function_decleration(std::vector<Token_Type> tokens) {}
-void parse_add_assign(std::vector<Token_Type> tokens) {}
-int  main(void) {
-    // Initialize canvas.
-    uint32_t pixels[IMG_WIDTH * IMG_HEIGHT];
-    canvas = olivec_canvas(pixels, IMG_WIDTH, IMG_HEIGHT, IMG_WIDTH);
-
-    // Initialize app state.
-    pen_state.direction = 0;
-    pen_state.down      = false;
-    pen_state.pos[0]    = 1.0;
-    pen_state.pos[1]    = 0.0;
-    auto contents       = read_file("./logo_examples/1_08_harder_combo.lg");
-    auto lines          = split(contents, '\n');
-    for (auto line : lines) {
-        cout << line;
-        parse_line(line);
+    if (watched ? positional.size() != 1 : positional.size() > 2) {
+        print_usage();
+        exit(-1);
+    }
+    auto path   = watched ? watched : positional.size() > 0 ? positional[0] : "./logo_examples/1_08_harder_combo.lg";
+    auto output = watched ? positional[0] : positional.size() > 1 ? positional[1] : nullptr;
+    // Without --format the output's extension decides.
+    if (output && !format_picked) {
+        auto extension = filesystem::path(output).extension().string();
+        auto format    = parse_image_format(string_view(extension).substr(min<size_t>(1, extension.size())));
+        if (format) options.encode.format = *format;
+    }
+    if (dump) exit(dump_ir(path) ? 0 : -1);
+    if (watched) watch(path, output, options.encode);
+
+    // Initialize app state. The turtle starts in the middle of the canvas, facing up, with a white pen.
+    Interpreter ctx;
+    reset_interpreter(ctx, IMG_WIDTH, IMG_HEIGHT);
+
+    // Lex and parse the whole file once up front, so executing loops never touches the source text again.
+    Render_Timing    timing;
+    vector<uint32_t> pixels;
+    Thread_Pool      pool;
+    pool_start(pool, thread::hardware_concurrency());
+    options.encode.pool = &pool;
+    auto success        = execute_file(path, ctx, timing);
+    success             = success && render_image(ctx, 1, output, options.encode, pixels, &pool, timing);
+    pool_stop(pool);
+    if (!success) {
+        exit(-1);
     }
 }
-/*
-    Renderer stuff.
-*/
-void draw_line(float start[2], float end[2]) {
-    // need to do proper translation of pen colors (4 bits) to hex(32 bits).
-    olivec_line(canvas, start[0], start[1], start[0], start[1], 0xffaa27ff);
-}
\ No newline at end of file
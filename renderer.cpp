@@ -0,0 +1,585 @@
+#define OLIVEC_IMPLEMENTATION
+#include "renderer.hpp"
+#include "kernels.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <bit>
+#include <climits>
+#include <cmath>
+
+using namespace std;
+
+/*
+    Display list.
+*/
+// Liang-Barsky: cuts the segment down to the part inside the rectangle. Returns false if none of it is. Ends that are
+// already inside are left exactly as they were.
+static bool clip_segment(double& x0, double& y0, double& x1, double& y1, double lo_x, double lo_y, double hi_x,
+                         double hi_y) {
+    double dx = x1 - x0, dy = y1 - y0;
+    double p[] = {-dx, dx, -dy, dy};
+    double q[] = {x0 - lo_x, hi_x - x0, y0 - lo_y, hi_y - y0};
+    double enter = 0, leave = 1;
+    for (int i = 0; i < 4; i++) {
+        if (p[i] == 0) {
+            if (q[i] < 0) return false;
+            continue;
+        }
+        double t = q[i] / p[i];
+        if (p[i] < 0) {
+            enter = max(enter, t);
+        } else {
+            leave = min(leave, t);
+        }
+    }
+    if (enter > leave) return false;
+    double start_x = x0, start_y = y0;
+    if (leave < 1) x1 = start_x + leave * dx, y1 = start_y + leave * dy;
+    if (enter > 0) x0 = start_x + enter * dx, y0 = start_y + enter * dy;
+    return true;
+}
+
+// Far enough that nothing near it is ever on a canvas, and near enough that a float still holds it after scaling.
+constexpr double FAR_AWAY = 1e30;
+
+void display_list_clear(Display_List& list) {
+    list.x0.clear();
+    list.y0.clear();
+    list.x1.clear();
+    list.y1.clear();
+    list.color.clear();
+    list.width.clear();
+}
+
+void display_list_push(Display_List& list, const double start[2], const double end[2], uint8_t color,
+                       uint8_t width) {
+    TRACE_COUNT(Segments_Recorded, 1);
+    double x0 = start[0], y0 = start[1], x1 = end[0], y1 = end[1];
+    // Converting a double too big for a float is undefined, so segments that go that far are cut short first.
+    if (max({fabs(x0), fabs(y0), fabs(x1), fabs(y1)}) > FAR_AWAY &&
+        !clip_segment(x0, y0, x1, y1, -FAR_AWAY, -FAR_AWAY, FAR_AWAY, FAR_AWAY)) {
+        x0 = clamp(x0, -FAR_AWAY, FAR_AWAY), y0 = clamp(y0, -FAR_AWAY, FAR_AWAY);
+        x1 = clamp(x1, -FAR_AWAY, FAR_AWAY), y1 = clamp(y1, -FAR_AWAY, FAR_AWAY);
+    }
+    list.x0.push_back((float)x0);
+    list.y0.push_back((float)y0);
+    list.x1.push_back((float)x1);
+    list.y1.push_back((float)y1);
+    list.color.push_back(color);
+    list.width.push_back(width);
+}
+
+size_t display_list_size(const Display_List& list) {
+    return list.x0.size();
+}
+
+/*
+    Renderer stuff.
+*/
+void clear_canvas(Olivec_Canvas canvas) {
+    if (canvas.stride == canvas.width) {
+        fill_span(canvas.pixels, canvas.width * canvas.height, 0xff000000);
+        return;
+    }
+    for (size_t y = 0; y < canvas.height; y++) fill_span(&OLIVEC_PIXEL(canvas, 0, y), canvas.width, 0xff000000);
+}
+
+// SETPENCOLOR's 16 colors, the same ones UCBLogo uses, as olive's 0xAABBGGRR.
+constexpr uint32_t PEN_PALETTE[16] = {
+    0xff000000, // Black
+    0xffff0000, // Blue
+    0xff00ff00, // Green
+    0xffffff00, // Cyan
+    0xff0000ff, // Red
+    0xffff00ff, // Magenta
+    0xff00ffff, // Yellow
+    0xffffffff, // White
+    0xff3b609b, // Brown
+    0xff1288c5, // Tan
+    0xff40a264, // Forest
+    0xffbbbb78, // Aqua
+    0xff7795ff, // Salmon
+    0xffd07190, // Purple
+    0xff00a3ff, // Orange
+    0xffb7b7b7, // Grey
+};
+
+static uint32_t pen_color_to_pixel(uint8_t color) {
+    return PEN_PALETTE[color & 15];
+}
+
+// A segment that's been scaled into canvas space, waiting to see whether the next one extends it. It's kept in double
+// until it has been clipped, the turtle can wander far further than a float can hold once scaled.
+struct Pending_Line {
+    double  x0, y0, x1, y1;
+    uint8_t color;
+    uint8_t width;
+    size_t  end; // One past the last segment of the list merged into it.
+};
+
+// Inclusive pixel bounds a line is drawn into.
+struct Clip_Rect {
+    int x0, y0, x1, y1;
+};
+
+// Grows to hold whatever is added to it with grow_rect, and until then holds nothing.
+constexpr Clip_Rect NO_PIXELS = {INT_MAX, INT_MAX, INT_MIN, INT_MIN};
+
+static void grow_rect(Clip_Rect& rect, int x0, int y0, int x1, int y1) {
+    rect = {min(rect.x0, x0), min(rect.y0, y0), max(rect.x1, x1), max(rect.y1, y1)};
+}
+
+// The next segment only extends the previous one if it carries on from its end, in the same direction, with the same
+// pen. Turtle programs draw long straight strokes as many short moves, so this saves a lot of line setup.
+static bool extends(const Pending_Line& line, double x0, double y0, double x1, double y1, uint8_t color,
+                    uint8_t width) {
+    if (line.color != color || line.width != width || line.x1 != x0 || line.y1 != y0) return false;
+    double ax = line.x1 - line.x0, ay = line.y1 - line.y0;
+    double bx = x1 - x0, by = y1 - y0;
+    double cross = ax * by - ay * bx;
+    double dot   = ax * bx + ay * by;
+    return dot > 0 && fabs(cross) <= 1e-6 * sqrt((ax * ax + ay * ay) * (bx * bx + by * by));
+}
+
+// How far from the line itself a pixel it draws into can be, so culling and binning never miss one. Hairlines touch
+// the pixels either side of them, give or take fixed point rounding, and thick lines reach half a pixel past their
+// edge.
+static float pen_reach(float width) {
+    return width > 1 ? width / 2 + 0.5f : 1.25f;
+}
+
+static float line_reach(const Raster_Line& line) {
+    return pen_reach(line.width);
+}
+
+// Hairlines step along their minor axis in 16.16 fixed point. The position at every step is start + step * i, exact
+// in integers, so a line drawn tile by tile lands on exactly the pixels it would have drawn in one go.
+constexpr int    FIXED_SHIFT = 16;
+constexpr double FIXED_ONE   = 1 << FIXED_SHIFT;
+
+// A hairline set up to step one pixel at a time along its major axis, x for mostly horizontal lines and y otherwise.
+struct Hairline {
+    int64_t   start; // The minor coordinate at major coordinate 0, in fixed point.
+    int64_t   step;
+    int64_t   lo, hi;       // The minor coordinates of the endpoints, which steps past either end are clamped to.
+    ptrdiff_t major_stride; // How far apart in memory pixels one step apart along each axis are.
+    ptrdiff_t minor_stride;
+    // The alpha a pixel the line runs straight through is blended with: the color's own, less for lines under a pixel
+    // wide.
+    uint32_t  alpha;
+    uint32_t  color;
+};
+
+// Wu's algorithm over major coordinates [from, to]: each step splits the line's coverage between the two pixels its
+// minor coordinate falls between. The caller has already worked out which of the two are inside for every step, so
+// the loop has no bounds checks.
+template <bool NEAR, bool FAR>
+static void hairline_run(Olivec_Canvas canvas, const Hairline& line, int from, int to) {
+    auto unclamped = line.start + line.step * from;
+    for (int major = from; major <= to; major++, unclamped += line.step) {
+        auto     minor = clamp(unclamped, line.lo, line.hi);
+        uint32_t far   = div_255((uint32_t)(minor >> (FIXED_SHIFT - 8) & 0xff) * line.alpha);
+        auto     pixel = canvas.pixels + major * line.major_stride + (minor >> FIXED_SHIFT) * line.minor_stride;
+        if (NEAR) blend_pixel(pixel, line.color, line.alpha - far);
+        if (FAR) blend_pixel(pixel + line.minor_stride, line.color, far);
+    }
+}
+
+static int64_t floor_div(int64_t a, int64_t b) {
+    return a / b - ((a % b != 0) && ((a < 0) != (b < 0)));
+}
+
+// The minor coordinate only ever moves one way. Going up, this is the first step where it's at least `threshold`;
+// going down, the first step where it's below it. Either way it's where the line crosses `threshold`, clamped to
+// [from, to + 1].
+static int crossing(const Hairline& line, int64_t threshold, int from, int to) {
+    int64_t step;
+    if (line.step > 0) {
+        if (line.lo >= threshold) return from;
+        if (line.hi < threshold) return to + 1;
+        step = -floor_div(line.start - threshold, line.step);
+    } else {
+        if (line.hi < threshold) return from;
+        if (line.lo >= threshold) return to + 1;
+        step = floor_div(threshold - line.start, line.step) + 1;
+    }
+    return (int)clamp(step, (int64_t)from, (int64_t)to + 1);
+}
+
+// Pixel centers sit on whole coordinates, so a line along a whole coordinate is exactly one pixel wide. The ends are
+// first clipped to the canvas in double, so they always fit in 16.16 fixed point, and the canvas is the same for every
+// tile. Then the line is clipped to `clip` once up front: along its major axis directly, and along its minor axis by
+// finding where it crosses each edge. Between those crossings each step draws only its far pixel, both, or only its
+// near one.
+static void draw_hairline(Olivec_Canvas canvas, const Raster_Line& line, Clip_Rect clip, Clip_Rect& touched) {
+    bool   steep = fabsf(line.y1 - line.y0) > fabsf(line.x1 - line.x0);
+    double a0 = line.x0, b0 = line.y0, a1 = line.x1, b1 = line.y1;
+    float  reach = line_reach(line);
+    if (!clip_segment(a0, b0, a1, b1, -reach, -reach, canvas.width - 1.0 + reach, canvas.height - 1.0 + reach)) return;
+    if (steep) swap(a0, b0), swap(a1, b1);
+    if (a0 > a1) swap(a0, a1), swap(b0, b1);
+    int major_lo = steep ? clip.y0 : clip.x0, major_hi = steep ? clip.y1 : clip.x1;
+    int minor_lo = steep ? clip.x0 : clip.y0, minor_hi = steep ? clip.x1 : clip.y1;
+    int from = (int)max(floor(a0 + 0.5), (double)major_lo), to = (int)min(floor(a1 + 0.5), (double)major_hi);
+    if (from > to) return;
+
+    double   slope = a1 > a0 ? (b1 - b0) / (a1 - a0) : 0;
+    Hairline hairline;
+    hairline.start        = (int64_t)((b0 - slope * a0) * FIXED_ONE);
+    hairline.step         = (int64_t)(slope * FIXED_ONE);
+    hairline.lo           = (int64_t)(min(b0, b1) * FIXED_ONE);
+    hairline.hi           = (int64_t)(max(b0, b1) * FIXED_ONE);
+    hairline.major_stride = steep ? canvas.stride : 1;
+    hairline.minor_stride = steep ? 1 : canvas.stride;
+    hairline.alpha        = (uint32_t)(clamp(line.width, 0.0f, 1.0f) * (line.color >> 24) + 0.5f);
+    hairline.color        = line.color;
+
+    // Every pixel it blends is between the near pixel of its first step and the far pixel of its last.
+    int minor_from = (int)(clamp(hairline.start + hairline.step * from, hairline.lo, hairline.hi) >> FIXED_SHIFT);
+    int minor_to   = (int)(clamp(hairline.start + hairline.step * to, hairline.lo, hairline.hi) >> FIXED_SHIFT);
+    if (minor_from > minor_to) swap(minor_from, minor_to);
+    minor_from = max(minor_from, minor_lo), minor_to = min(minor_to + 1, minor_hi);
+    if (minor_from <= minor_to) {
+        if (steep) grow_rect(touched, minor_from, from, minor_to, to);
+        else grow_rect(touched, from, minor_from, to, minor_to);
+    }
+
+    // Straight along an axis, every step covers the same two pixels the same amount, and in a row those are spans.
+    if (hairline.step == 0) {
+        auto     minor = clamp(hairline.start, hairline.lo, hairline.hi);
+        int      near  = (int)(minor >> FIXED_SHIFT);
+        uint32_t far   = div_255((uint32_t)(minor >> (FIXED_SHIFT - 8) & 0xff) * hairline.alpha);
+        for (auto [at, alpha] : {pair{near, hairline.alpha - far}, pair{near + 1, far}}) {
+            if (alpha == 0 || at < minor_lo || at > minor_hi) continue;
+            auto color = (line.color & 0x00ffffff) | alpha << 24;
+            if (!steep) {
+                blend_span(&OLIVEC_PIXEL(canvas, from, at), to - from + 1, color);
+                continue;
+            }
+            for (int major = from; major <= to; major++) blend_pixel(&OLIVEC_PIXEL(canvas, at, major), color, alpha);
+        }
+        return;
+    }
+
+    // Most lines are short enough to sit entirely inside, and need nothing more.
+    int64_t inside_lo = (int64_t)minor_lo << FIXED_SHIFT, inside_hi = (int64_t)minor_hi << FIXED_SHIFT;
+    if (hairline.lo >= inside_lo && hairline.hi < inside_hi) {
+        hairline_run<true, true>(canvas, hairline, from, to);
+        TRACE_COUNT(Pixels_Blended, 2 * (to - from + 1));
+        return;
+    }
+
+    // Where the minor coordinate crosses into the pixel just before the clip, into its first pixel, into its last and
+    // past it. In the pixel before only the far pixel is inside, in the last only the near one.
+    int before = crossing(hairline, inside_lo - (1 << FIXED_SHIFT), from, to);
+    int first  = crossing(hairline, inside_lo, from, to);
+    int last   = crossing(hairline, inside_hi, from, to);
+    int after  = crossing(hairline, inside_hi + (1 << FIXED_SHIFT), from, to);
+    if (hairline.step > 0) {
+        hairline_run<false, true>(canvas, hairline, before, first - 1);
+        hairline_run<true, true>(canvas, hairline, first, last - 1);
+        hairline_run<true, false>(canvas, hairline, last, after - 1);
+    } else {
+        hairline_run<true, false>(canvas, hairline, after, last - 1);
+        hairline_run<true, true>(canvas, hairline, last, first - 1);
+        hairline_run<false, true>(canvas, hairline, first, before - 1);
+    }
+    TRACE_COUNT(Pixels_Blended, 2 * abs(after - before));
+}
+
+// Wider pens draw a capsule, every pixel whose center is within half the width of the segment, so the round ends of
+// consecutive segments join up without gaps. A pixel on the edge is covered by how far inside the edge its center
+// is, which is close to the area of it that's covered.
+struct Capsule {
+    float x0, y0, dx, dy;
+    float inv_length2, inv_dy;
+    float inner, outer;
+};
+
+static Capsule capsule(const Raster_Line& line) {
+    float dx = line.x1 - line.x0, dy = line.y1 - line.y0, length2 = dx * dx + dy * dy;
+    return {line.x0, line.y0, dx, dy, length2 > 0 ? 1 / length2 : 0, dy != 0 ? 1 / dy : 0, line.width / 2 - 0.5f,
+            line.width / 2 + 0.5f};
+}
+
+// The pixels of row y the capsule can reach, which might be none. The row can only cross it next to the part of the
+// segment within `outer` of it vertically.
+static void capsule_row(const Capsule& capsule, int y, int& from, int& to) {
+    float lo_x = min(capsule.x0, capsule.x0 + capsule.dx), hi_x = max(capsule.x0, capsule.x0 + capsule.dx);
+    if (capsule.dy != 0) {
+        float ta = clamp((y - capsule.outer - capsule.y0) * capsule.inv_dy, 0.0f, 1.0f);
+        float tb = clamp((y + capsule.outer - capsule.y0) * capsule.inv_dy, 0.0f, 1.0f);
+        lo_x     = capsule.x0 + capsule.dx * min(ta, tb);
+        hi_x     = capsule.x0 + capsule.dx * max(ta, tb);
+        if (lo_x > hi_x) swap(lo_x, hi_x);
+    }
+    from = (int)ceilf(lo_x - capsule.outer);
+    to   = (int)floorf(hi_x + capsule.outer);
+}
+
+static uint8_t capsule_coverage(const Capsule& capsule, int x, int y) {
+    float px = x - capsule.x0, py = y - capsule.y0;
+    float t  = clamp((px * capsule.dx + py * capsule.dy) * capsule.inv_length2, 0.0f, 1.0f);
+    float ex = px - t * capsule.dx, ey = py - t * capsule.dy, distance2 = ex * ex + ey * ey;
+    if (distance2 <= capsule.inner * capsule.inner) return 255;
+    if (distance2 >= capsule.outer * capsule.outer) return 0;
+    return (uint8_t)((capsule.outer - sqrtf(distance2)) * 255 + 0.5f);
+}
+
+// Each row only visits the pixels the capsule can reach, works out their coverage and blends them in one go. Where
+// the line carries on from `previous`, a pixel both cover ends up covered by the larger of the two rather than both
+// blended over each other, which would leave a darker seam along the edges at every joint.
+static void draw_thick_line(Olivec_Canvas canvas, const Raster_Line& line, const Raster_Line* previous,
+                            Clip_Rect clip, Clip_Rect& touched) {
+    constexpr int CHUNK = 256;
+
+    auto shape  = capsule(line);
+    int  y_from = (int)max(ceilf(min(line.y0, line.y1) - shape.outer), (float)clip.y0);
+    int  y_to   = (int)min(floorf(max(line.y0, line.y1) + shape.outer), (float)clip.y1);
+    // Only the rows and the part of each row the previous line reaches can be covered twice.
+    auto under        = previous ? capsule(*previous) : shape;
+    int  under_y_from = previous ? (int)ceilf(min(previous->y0, previous->y1) - under.outer) : 0;
+    int  under_y_to   = previous ? (int)floorf(max(previous->y0, previous->y1) + under.outer) : -1;
+
+    uint8_t coverage[CHUNK];
+    for (int y = y_from; y <= y_to; y++) {
+        int x_from, x_to, under_from = 0, under_to = -1;
+        capsule_row(shape, y, x_from, x_to);
+        x_from = max(x_from, clip.x0), x_to = min(x_to, clip.x1);
+        if (x_from <= x_to) grow_rect(touched, x_from, y, x_to, y);
+        if (y >= under_y_from && y <= under_y_to) capsule_row(under, y, under_from, under_to);
+        for (int x = x_from; x <= x_to; x += CHUNK) {
+            int count = min(CHUNK, x_to - x + 1);
+            for (int i = 0; i < count; i++) coverage[i] = capsule_coverage(shape, x + i, y);
+            // The previous line already blended `covered`, so only the rest of the way to the larger coverage is
+            // left: blending c after it gives 1 - (1 - covered)(1 - c), which has to come out as coverage[i].
+            for (int i = max(under_from - x, 0); i < min(under_to - x + 1, count); i++) {
+                uint32_t wanted = coverage[i], covered = wanted ? capsule_coverage(under, x + i, y) : 0;
+                if (covered == 0) continue;
+                if (wanted <= covered) {
+                    coverage[i] = 0;
+                    continue;
+                }
+                coverage[i] = ((wanted - covered) * 255 + (255 - covered) / 2) / (255 - covered);
+            }
+            blend_coverage_span(&OLIVEC_PIXEL(canvas, x, y), coverage, count, line.color);
+        }
+    }
+}
+
+// Draws the part of the line inside `clip`. Every pixel only depends on the line and not on the clip, so drawing a
+// line tile by tile gives the same pixels as drawing it in one go. `touched` grows to hold the spans it drew.
+static void draw_line(Olivec_Canvas canvas, const Raster_Line& line, const Raster_Line* previous, Clip_Rect clip,
+                      Clip_Rect& touched) {
+    TRACE_COUNT(Lines_Drawn, 1);
+    if (line.width > 1) {
+        draw_thick_line(canvas, line, line.joins ? previous : nullptr, clip, touched);
+    } else {
+        draw_hairline(canvas, line, clip, touched);
+    }
+}
+
+// Walks the list a batch at a time, scaling every segment and merging it into its predecessor where possible. The
+// merged lines that are still on the canvas are appended to `lines` in drawing order, and with `ends` where in the
+// list each of them ends.
+static void collect_lines(size_t width, size_t height, const Display_List& list, float scale,
+                          vector<Raster_Line>& lines, vector<size_t>* ends, Raster_Stats& stats) {
+    constexpr size_t BATCH_SIZE = 256;
+
+    Pending_Line batch[BATCH_SIZE + 1]; // Plus the line held back from the previous batch.
+    size_t       pending = 0;
+    auto         count   = display_list_size(list);
+
+    for (size_t first = 0; first < count; first += BATCH_SIZE) {
+        auto last = min(first + BATCH_SIZE, count);
+        for (size_t i = first; i < last; i++) {
+            double x0 = (double)list.x0[i] * scale, y0 = (double)list.y0[i] * scale;
+            double x1 = (double)list.x1[i] * scale, y1 = (double)list.y1[i] * scale;
+            if (pending > 0 && extends(batch[pending - 1], x0, y0, x1, y1, list.color[i], list.width[i])) {
+                batch[pending - 1].x1  = x1;
+                batch[pending - 1].y1  = y1;
+                batch[pending - 1].end = i + 1;
+                stats.merged++;
+                continue;
+            }
+            batch[pending++] = {x0, y0, x1, y1, list.color[i], list.width[i], i + 1};
+        }
+
+        // Keep the last line back, the next batch might still extend it.
+        auto ready = last == count ? pending : pending - 1;
+        for (size_t i = 0; i < ready; i++) {
+            // Clipped to the canvas grown by how far from the line it can draw, so the clipped ends never show.
+            auto& merged = batch[i];
+            float pen    = merged.width * scale;
+            float reach  = pen_reach(pen);
+            if (!clip_segment(merged.x0, merged.y0, merged.x1, merged.y1, -reach, -reach, width - 1.0 + reach,
+                              height - 1.0 + reach)) {
+                stats.culled++;
+                continue;
+            }
+            Raster_Line line = {(float)merged.x0, (float)merged.y0, (float)merged.x1, (float)merged.y1, pen,
+                                pen_color_to_pixel(merged.color), false};
+            // Culled lines draw nothing, so the last line kept is the last one drawn.
+            if (!lines.empty()) {
+                auto& last = lines.back();
+                line.joins = last.x1 == line.x0 && last.y1 == line.y0 && last.width == line.width &&
+                             last.color == line.color;
+            }
+            lines.push_back(line);
+            if (ends) ends->push_back(merged.end);
+        }
+        if (ready < pending) batch[0] = batch[pending - 1];
+        pending -= ready;
+    }
+}
+
+// Adds the line to the bin of every tile it might touch. For each row of tiles it crosses, the line is cut down to the
+// part of it within reach of that band of pixels, so long diagonals don't land in every tile of their bounding box.
+static void bin_line(const Raster_Line& line, uint32_t index, size_t columns, size_t rows,
+                     vector<vector<uint32_t>>& bins) {
+    constexpr float T      = RASTER_TILE_SIZE;
+    float           reach  = line_reach(line);
+    float           dx     = line.x1 - line.x0, dy = line.y1 - line.y0;
+    float           inv_dy = dy != 0 ? 1 / dy : 0;
+    int first_row = (int)max(floorf((min(line.y0, line.y1) - reach) / T), 0.0f);
+    int last_row  = (int)min(floorf((max(line.y0, line.y1) + reach) / T), rows - 1.0f);
+    for (int row = first_row; row <= last_row; row++) {
+        float lo_x = min(line.x0, line.x1), hi_x = max(line.x0, line.x1);
+        // Within a single row of tiles the cut can't do better than the whole line, which is most short lines.
+        if (dy != 0 && first_row != last_row) {
+            float ta = clamp((row * T - reach - line.y0) * inv_dy, 0.0f, 1.0f);
+            float tb = clamp(((row + 1) * T - 1 + reach - line.y0) * inv_dy, 0.0f, 1.0f);
+            float xa = line.x0 + dx * ta, xb = line.x0 + dx * tb;
+            lo_x = min(xa, xb), hi_x = max(xa, xb);
+        }
+        int first_column = (int)max(floorf((lo_x - reach) / T), 0.0f);
+        int last_column  = (int)min(floorf((hi_x + reach) / T), columns - 1.0f);
+        for (int column = first_column; column <= last_column; column++) {
+            bins[row * columns + column].push_back(index);
+        }
+    }
+}
+
+static const Raster_Line* previous_line(const Raster_Plan& plan, uint32_t index) {
+    return index > 0 ? &plan.lines[index - 1] : nullptr;
+}
+
+static Clip_Rect tile_rect(size_t width, size_t height, size_t columns, size_t tile) {
+    int x = tile % columns * RASTER_TILE_SIZE, y = tile / columns * RASTER_TILE_SIZE;
+    return {x, y, min(x + RASTER_TILE_SIZE, (int)width) - 1, min(y + RASTER_TILE_SIZE, (int)height) - 1};
+}
+
+void plan_raster(Raster_Plan& plan, size_t width, size_t height, const Display_List& list, float scale) {
+    TRACE_SCOPE("plan raster");
+    plan.width   = width;
+    plan.height  = height;
+    plan.columns = (width + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+    plan.rows    = (height + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+    plan.stats   = {0, 0, 0};
+    plan.lines.clear();
+    plan.ends.clear();
+    collect_lines(width, height, list, scale, plan.lines, &plan.ends, plan.stats);
+    plan.stats.drawn = plan.lines.size();
+
+    plan.bins.resize(plan.columns * plan.rows);
+    for (auto& bin : plan.bins) bin.clear();
+    for (uint32_t i = 0; i < plan.lines.size(); i++) bin_line(plan.lines[i], i, plan.columns, plan.rows, plan.bins);
+}
+
+// FNV-1a over every line drawn into the tile, in order. Two plans with the same hash for a tile draw the same pixels
+// there, so only tiles whose hash changed need drawing again.
+uint64_t tile_hash(const Raster_Plan& plan, size_t tile) {
+    uint64_t hash = 14695981039346656037ull;
+    for (auto index : plan.bins[tile]) {
+        auto& line = plan.lines[index];
+        for (uint32_t field : {bit_cast<uint32_t>(line.x0), bit_cast<uint32_t>(line.y0), bit_cast<uint32_t>(line.x1),
+                               bit_cast<uint32_t>(line.y1), bit_cast<uint32_t>(line.width), line.color,
+                               (uint32_t)line.joins}) {
+            hash = (hash ^ field) * 1099511628211ull;
+        }
+    }
+    return hash;
+}
+
+// Draws the lines in [first, last) of each tile's bin, clearing it first if asked to. Bins are in drawing order, so
+// each tile's part of the range is one run of its bin. With `touched` each tile's spans are added to touched[i].
+static void draw_tiles(Olivec_Canvas canvas, const Raster_Plan& plan, span<const uint32_t> tiles, Thread_Pool* pool,
+                       bool clear, uint32_t first, uint32_t last, Clip_Rect* touched) {
+    auto draw = [&](size_t i) {
+        TRACE_SCOPE("tile");
+        auto tile = tiles[i];
+        auto clip = tile_rect(plan.width, plan.height, plan.columns, tile);
+        for (int y = clip.y0; clear && y <= clip.y1; y++) {
+            fill_span(&OLIVEC_PIXEL(canvas, clip.x0, y), clip.x1 - clip.x0 + 1, 0xff000000);
+        }
+        auto& bin   = plan.bins[tile];
+        auto  spans = NO_PIXELS;
+        auto  from  = lower_bound(bin.begin(), bin.end(), first);
+        for (auto it = from; it != bin.end() && *it < last; ++it) {
+            draw_line(canvas, plan.lines[*it], previous_line(plan, *it), clip, spans);
+        }
+        if (touched) touched[i] = spans;
+    };
+    if (!pool) {
+        for (size_t i = 0; i < tiles.size(); i++) draw(i);
+        return;
+    }
+    pool_parallel_for(*pool, tiles.size(), draw);
+}
+
+// Clears each of the given tiles and draws its lines again, spread over the pool if there is one.
+void redraw_tiles(Olivec_Canvas canvas, const Raster_Plan& plan, span<const uint32_t> tiles, Thread_Pool* pool) {
+    draw_tiles(canvas, plan, tiles, pool, true, 0, plan.lines.size(), nullptr);
+}
+
+// Draws lines [first, last) of the plan over what's already on the canvas, which has to hold the lines before them.
+// Every pixel comes out as rasterize would have left it after those lines, joints across `first` included. For each
+// tile the lines drew into, `dirty` gets the rectangle their spans covered in it, in tile order.
+void draw_lines_over(Olivec_Canvas canvas, const Raster_Plan& plan, size_t first, size_t last, Thread_Pool* pool,
+                     vector<Pixel_Rect>& dirty) {
+    dirty.clear();
+    vector<uint32_t> tiles;
+    for (uint32_t tile = 0; tile < plan.bins.size(); tile++) {
+        auto& bin  = plan.bins[tile];
+        auto  from = lower_bound(bin.begin(), bin.end(), (uint32_t)first);
+        if (from != bin.end() && *from < last) tiles.push_back(tile);
+    }
+    vector<Clip_Rect> touched(tiles.size());
+    draw_tiles(canvas, plan, tiles, pool, false, first, last, touched.data());
+    for (auto& rect : touched) {
+        if (rect.x0 > rect.x1) continue;
+        dirty.push_back({(size_t)rect.x0, (size_t)rect.y0, (size_t)(rect.x1 - rect.x0 + 1),
+                         (size_t)(rect.y1 - rect.y0 + 1)});
+    }
+}
+
+// Merges and culls the display list, then draws what's left. With a pool the canvas is cut into tiles that are drawn
+// in parallel, each tile drawing its lines in list order so every pixel is blended exactly as the serial path does.
+Raster_Stats rasterize(Olivec_Canvas canvas, const Display_List& list, float scale, Thread_Pool* pool) {
+    TRACE_SCOPE("raster");
+    auto columns = (canvas.width + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+    auto rows    = (canvas.height + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+    if (!pool || columns * rows <= 1) {
+        Raster_Stats        stats = {0, 0, 0};
+        vector<Raster_Line> lines;
+        collect_lines(canvas.width, canvas.height, list, scale, lines, nullptr, stats);
+        stats.drawn     = lines.size();
+        Clip_Rect whole = {0, 0, (int)canvas.width - 1, (int)canvas.height - 1}, touched = NO_PIXELS;
+        for (size_t i = 0; i < lines.size(); i++) {
+            draw_line(canvas, lines[i], i > 0 ? &lines[i - 1] : nullptr, whole, touched);
+        }
+        return stats;
+    }
+
+    Raster_Plan plan;
+    plan_raster(plan, canvas.width, canvas.height, list, scale);
+    pool_parallel_for(*pool, plan.bins.size(), [&](size_t tile) {
+        TRACE_SCOPE("tile");
+        auto clip = tile_rect(canvas.width, canvas.height, columns, tile);
+        auto touched = NO_PIXELS;
+        for (auto index : plan.bins[tile]) {
+            draw_line(canvas, plan.lines[index], previous_line(plan, index), clip, touched);
+        }
+    });
+    return plan.stats;
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include "third_party/olive.h"
+#include "thread_pool.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Every segment the turtle drew, in drawing order. The fields are stored column by column so the rasterizer only
+// streams through what it needs, and so the same list can be drawn again at another size without re-running the
+// program that made it. Coordinates are in the program's own canvas space.
+struct Display_List {
+    std::vector<float>   x0;
+    std::vector<float>   y0;
+    std::vector<float>   x1;
+    std::vector<float>   y1;
+    std::vector<uint8_t> color;
+    std::vector<uint8_t> width;
+};
+
+// The rasterizer splits the canvas into squares this big and draws them in parallel.
+constexpr int RASTER_TILE_SIZE = 64;
+
+struct Raster_Stats {
+    size_t culled; // Segments that were entirely off the canvas.
+    size_t merged; // Segments folded into the one before them.
+    size_t drawn;
+};
+
+// A merged line in canvas pixels. Pixel (x, y) is centered on those whole coordinates.
+struct Raster_Line {
+    float    x0, y0, x1, y1;
+    float    width; // In pixels, a hairline if it's 1 or less.
+    uint32_t color; // Looked up from the pen color.
+    // Whether it carries on from the end of the line drawn just before it with the same pen, so a thick line only adds
+    // what the one before didn't already cover around the joint.
+    bool     joins;
+};
+
+// A rectangle of canvas pixels.
+struct Pixel_Rect {
+    size_t x, y, width, height;
+};
+
+// What rasterize would draw, with every line binned into the tiles it touches, so a caller can draw again just the
+// tiles that changed.
+struct Raster_Plan {
+    size_t                             width;
+    size_t                             height;
+    size_t                             columns;
+    size_t                             rows;
+    std::vector<Raster_Line>           lines;
+    std::vector<size_t>                ends; // Per line, one past the last segment of the list merged into it.
+    std::vector<std::vector<uint32_t>> bins; // Per tile, row by row, the indices of its lines in drawing order.
+    Raster_Stats                       stats;
+};
+
+void   display_list_clear(Display_List& list);
+// The turtle keeps its position in double, but a float is plenty for drawing.
+void   display_list_push(Display_List& list, const double start[2], const double end[2], uint8_t color,
+                         uint8_t width);
+size_t display_list_size(const Display_List& list);
+
+// Olive's functions are all static, so the rest of the program draws through these.
+void         clear_canvas(Olivec_Canvas canvas);
+// Without a pool the lines are drawn on the calling thread. The result is the same either way.
+Raster_Stats rasterize(Olivec_Canvas canvas, const Display_List& list, float scale, Thread_Pool* pool);
+void         plan_raster(Raster_Plan& plan, size_t width, size_t height, const Display_List& list, float scale);
+uint64_t     tile_hash(const Raster_Plan& plan, size_t tile);
+void redraw_tiles(Olivec_Canvas canvas, const Raster_Plan& plan, std::span<const uint32_t> tiles, Thread_Pool* pool);
+void draw_lines_over(Olivec_Canvas canvas, const Raster_Plan& plan, size_t first, size_t last, Thread_Pool* pool,
+                     std::vector<Pixel_Rect>& dirty);
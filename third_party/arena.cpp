@@ -1,43 +1,70 @@
 #include <assert.h>
 #include <stdlib.h>
-#include <string.h>
 
+#include <cstdint>
 #include <cstdio>
 #include <cstdlib>
 
 #include "arena.hpp"
 
-Arena* arena_new(size_t data_length) {
+static Arena_Chunk* chunk_new(size_t length) {
+    auto chunk = (Arena_Chunk*)malloc(sizeof(Arena_Chunk) + length);
+    assert(chunk != NULL);
+    chunk->next   = NULL;
+    chunk->length = length;
+    return chunk;
+}
+
+static char* chunk_data(Arena_Chunk* chunk) {
+    return (char*)(chunk + 1);
+}
+
+Arena* arena_new(size_t chunk_length) {
     auto arena = (Arena*)(malloc(sizeof(Arena)));
 
-    arena->offset = arena->length = data_length;
+    arena->chunk_length = chunk_length;
+    arena->first = arena->current = chunk_new(chunk_length);
+    arena->offset                 = 0;
     return arena;
 }
 
+// Keeps every chunk around, so refilling the arena afterwards doesn't have to malloc again.
 void arena_free_all(Arena* arena) {
-    arena->offset = 0;
+    arena->current = arena->first;
+    arena->offset  = 0;
 }
 
-// Just double the underlying data length.
-// void arena_resize(Arena* arena) { realloc(arena->data, arena->length * 3); }
+void* arena_alloc(Arena* arena, size_t size, size_t align) {
+    assert(align > 0 && (align & (align - 1)) == 0);
+    for (;;) {
+        auto base    = (uintptr_t)chunk_data(arena->current);
+        auto aligned = (base + arena->offset + align - 1) & ~(uintptr_t)(align - 1);
+        if (aligned + size <= base + arena->current->length) {
+            arena->offset = aligned + size - base;
+            return (void*)aligned;
+        }
 
-void* arena_alloc(Arena* arena, size_t size) {
-    // Check to see if the backing memory has space left
-    assert(arena->offset + size <= arena->length);
-
-    // Can probably just automatically resize if neccessary.
-    // However, that will probably fuck up pointers that point
-    // into some part of the arena.
-
-    void* ptr = &arena->data + arena->offset;
-    arena->offset += size;
-    // Zero new memory by default
-    memset(ptr, 0, size);
-    return ptr;
+        // Move on to the next chunk, reusing one left over from before a reset if it's big enough, otherwise
+        // slotting a new one in. Pointers into earlier chunks stay valid either way.
+        auto next = arena->current->next;
+        if (!next || next->length < size + align) {
+            auto length = size + align > arena->chunk_length ? size + align : arena->chunk_length;
+            auto chunk  = chunk_new(length);
+            chunk->next = next;
+            arena->current->next = chunk;
+            next                 = chunk;
+        }
+        arena->current = next;
+        arena->offset  = 0;
+    }
 }
 
 void arena_destroy(Arena* arena) {
-    assert(arena != NULL && arena->data != NULL);
-    free(arena->data);
+    assert(arena != NULL && arena->first != NULL);
+    for (auto chunk = arena->first; chunk;) {
+        auto next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
     free(arena);
-}
\ No newline at end of file
+}
@@ -1,13 +1,39 @@
 #pragma once
 #include <stdlib.h>
 
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+
+// Memory comes out of a list of chunks, so growing never moves anything that was already handed out.
+struct Arena_Chunk {
+    Arena_Chunk* next;
+    size_t       length; // Usable bytes after the header.
+};
+
 typedef struct Arena {
-    void*  data;
-    size_t offset;
-    size_t length;
+    Arena_Chunk* first;
+    Arena_Chunk* current;
+    size_t       offset;       // Bytes used in the current chunk.
+    size_t       chunk_length; // Size of new chunks, unless an allocation needs more.
 } Arena;
 
-Arena* arena_new(size_t data_length);
+Arena* arena_new(size_t chunk_length);
 void   arena_free_all(Arena* arena);
-void*  arena_alloc(Arena* arena, size_t size);
+void*  arena_alloc(Arena* arena, size_t size, size_t align = alignof(std::max_align_t));
 void   arena_destroy(Arena* arena);
+
+// Nothing allocated in an arena is ever destroyed, so only types without destructors may live in one. The objects are
+// value initialized, which zeroes plain data, so arena_alloc itself hands out memory as it finds it.
+template <typename T> T* alloc(Arena* arena, size_t count = 1) {
+    static_assert(std::is_trivially_destructible_v<T>, "Arena memory is never destructed.");
+    auto memory = arena_alloc(arena, sizeof(T) * count, alignof(T));
+    return new (memory) T[count]();
+}
+
+struct Arena_Deleter {
+    void operator()(Arena* arena) const { arena_destroy(arena); }
+};
+
+typedef std::unique_ptr<Arena, Arena_Deleter> Arena_Ptr;
@@ -34,6 +34,17 @@
 #define OLIVEC_AA_RES 2
 #endif
 
+// Rectangles and fills hand each row to these as one contiguous span. Define them before including olive.h to use
+// your own (for example SIMD) span routines; they must give the same result as olivec_fill_span and
+// olivec_blend_span.
+#ifndef OLIVEC_FILL_SPAN
+#define OLIVEC_FILL_SPAN(pixels, count, color) olivec_fill_span(pixels, count, color)
+#endif
+
+#ifndef OLIVEC_BLEND_SPAN
+#define OLIVEC_BLEND_SPAN(pixels, count, color) olivec_blend_span(pixels, count, color)
+#endif
+
 #define OLIVEC_SWAP(T, a, b) do { T t = a; a = b; b = t; } while (0)
 #define OLIVEC_SIGN(T, x) ((T)((x) > 0) - (T)((x) < 0))
 #define OLIVEC_ABS(T, x) (OLIVEC_SIGN(T, x)*(x))
@@ -416,6 +427,8 @@ OLIVECDEF Olivec_Canvas olivec_canvas(uint32_t *pixels, size_t width, size_t hei
 OLIVECDEF Olivec_Canvas olivec_subcanvas(Olivec_Canvas oc, int x, int y, int w, int h);
 OLIVECDEF bool olivec_in_bounds(Olivec_Canvas oc, int x, int y);
 OLIVECDEF void olivec_blend_color(uint32_t *c1, uint32_t c2);
+OLIVECDEF void olivec_fill_span(uint32_t *pixels, size_t count, uint32_t color);
+OLIVECDEF void olivec_blend_span(uint32_t *pixels, size_t count, uint32_t color);
 OLIVECDEF void olivec_fill(Olivec_Canvas oc, uint32_t color);
 OLIVECDEF void olivec_rect(Olivec_Canvas oc, int x, int y, int w, int h, uint32_t color);
 OLIVECDEF void olivec_frame(Olivec_Canvas oc, int x, int y, int w, int h, size_t thiccness, uint32_t color);
@@ -551,12 +564,24 @@ OLIVECDEF void olivec_blend_color(uint32_t *c1, uint32_t c2)
     *c1 = OLIVEC_RGBA(r1, g1, b1, a1);
 }
 
+OLIVECDEF void olivec_fill_span(uint32_t *pixels, size_t count, uint32_t color)
+{
+    for (size_t i = 0; i < count; ++i) {
+        pixels[i] = color;
+    }
+}
+
+OLIVECDEF void olivec_blend_span(uint32_t *pixels, size_t count, uint32_t color)
+{
+    for (size_t i = 0; i < count; ++i) {
+        olivec_blend_color(&pixels[i], color);
+    }
+}
+
 OLIVECDEF void olivec_fill(Olivec_Canvas oc, uint32_t color)
 {
     for (size_t y = 0; y < oc.height; ++y) {
-        for (size_t x = 0; x < oc.width; ++x) {
-            OLIVEC_PIXEL(oc, x, y) = color;
-        }
+        OLIVEC_FILL_SPAN(&OLIVEC_PIXEL(oc, 0, y), oc.width, color);
     }
 }
 
@@ -564,10 +589,8 @@ OLIVECDEF void olivec_rect(Olivec_Canvas oc, int x, int y, int w, int h, uint32_
 {
     Olivec_Normalized_Rect nr = {0};
     if (!olivec_normalize_rect(x, y, w, h, oc.width, oc.height, &nr)) return;
-    for (int x = nr.x1; x <= nr.x2; ++x) {
-        for (int y = nr.y1; y <= nr.y2; ++y) {
-            olivec_blend_color(&OLIVEC_PIXEL(oc, x, y), color);
-        }
+    for (int y = nr.y1; y <= nr.y2; ++y) {
+        OLIVEC_BLEND_SPAN(&OLIVEC_PIXEL(oc, nr.x1, y), nr.x2 - nr.x1 + 1, color);
     }
 }
 
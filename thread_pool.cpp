@@ -0,0 +1,125 @@
+#include "thread_pool.hpp"
+
+using namespace std;
+
+// The queue owned by the current thread, or SIZE_MAX for threads outside the pool.
+static thread_local size_t worker_index = SIZE_MAX;
+
+// Takes the task at the back or the front of `queue`, if there is one and it belongs to `group` (any group if null).
+static bool take(Work_Queue& queue, bool from_back, Task_Group* group, Queued_Task& task) {
+    lock_guard guard(queue.lock);
+    if (queue.tasks.empty()) return false;
+    auto& end = from_back ? queue.tasks.back() : queue.tasks.front();
+    if (group && end.group != group) return false;
+    task = std::move(end);
+    if (from_back) {
+        queue.tasks.pop_back();
+    } else {
+        queue.tasks.pop_front();
+    }
+    return true;
+}
+
+// A thread only ever waits on the group it submitted last, and everything it runs while waiting finishes, subtasks and
+// all, before it looks again. So if that group has anything left in the thread's own queue it's right at the back,
+// and one look at each end is enough to find it. Threads outside the pool treat the outside queue as their own.
+static bool try_pop(Thread_Pool& pool, Task_Group* group, Queued_Task& task) {
+    auto  count  = pool.queues.size();
+    bool  worker = worker_index < count;
+    auto& own    = worker ? *pool.queues[worker_index] : pool.outside;
+    bool  found  = take(own, true, group, task);
+    // Steal the oldest task from somebody else, starting just after our own queue so thieves spread out.
+    auto start = worker ? worker_index + 1 : 0;
+    for (size_t i = 0; i < count && !found; i++) {
+        auto index = (start + i) % count;
+        if (index != worker_index) found = take(*pool.queues[index], false, group, task);
+    }
+    if (!found && worker) found = take(pool.outside, false, group, task);
+    if (found) pool.queued--;
+    return found;
+}
+
+static void run_task(Thread_Pool& pool, Queued_Task& task) {
+    task.run();
+    task.run = nullptr;
+    if (task.group->pending.fetch_sub(1) == 1) {
+        lock_guard guard(pool.sleep_lock);
+        pool.done.notify_all();
+    }
+}
+
+static void worker_loop(Thread_Pool& pool, size_t index) {
+    worker_index = index;
+    Queued_Task task;
+    for (;;) {
+        if (try_pop(pool, nullptr, task)) {
+            run_task(pool, task);
+            continue;
+        }
+        unique_lock lock(pool.sleep_lock);
+        pool.wake.wait(lock, [&] { return pool.queued > 0 || pool.stopping; });
+        if (pool.stopping && pool.queued == 0) return;
+    }
+}
+
+void pool_start(Thread_Pool& pool, size_t threads) {
+    if (threads == 0) threads = 1;
+    pool.queued   = 0;
+    pool.stopping = false;
+    for (size_t i = 0; i < threads; i++) {
+        pool.queues.push_back(make_unique<Work_Queue>());
+    }
+    for (size_t i = 0; i < threads; i++) {
+        pool.workers.emplace_back(worker_loop, ref(pool), i);
+    }
+}
+
+void pool_submit(Thread_Pool& pool, Task_Group& group, Task task) {
+    group.pending++;
+    // Workers push onto their own queue so nested work stays local, everyone else onto the outside queue.
+    auto& queue = worker_index < pool.queues.size() ? *pool.queues[worker_index] : pool.outside;
+    // Count the task before it's visible, so a thief can never take queued below zero.
+    pool.queued++;
+    {
+        lock_guard guard(queue.lock);
+        queue.tasks.push_back({std::move(task), &group});
+    }
+    // One more task only needs one more worker. Whoever waits on the group is woken once it's finished.
+    lock_guard guard(pool.sleep_lock);
+    pool.wake.notify_one();
+}
+
+void pool_wait(Thread_Pool& pool, Task_Group& group) {
+    Queued_Task task;
+    while (group.pending > 0) {
+        // Help with our own group rather than block, otherwise a task waiting on its own subtasks could starve the
+        // pool. Other groups' tasks are left alone so nothing unrelated ever runs nested inside the caller.
+        if (try_pop(pool, &group, task)) {
+            run_task(pool, task);
+            continue;
+        }
+        // Nothing of ours is left to take, so the rest is in other threads' hands.
+        unique_lock lock(pool.sleep_lock);
+        pool.done.wait(lock, [&] { return group.pending == 0; });
+    }
+}
+
+void pool_stop(Thread_Pool& pool) {
+    {
+        lock_guard guard(pool.sleep_lock);
+        pool.stopping = true;
+        pool.wake.notify_all();
+    }
+    for (auto& worker : pool.workers) worker.join();
+    pool.workers.clear();
+    pool.queues.clear();
+}
+
+// Runs body(i) for every i below count across the pool, and only returns once they've all finished.
+void pool_parallel_for(Thread_Pool& pool, size_t count, const function<void(size_t)>& body) {
+    Task_Group group;
+    for (size_t i = 0; i < count; i++) {
+        pool_submit(pool, group, [&body, i] { body(i); });
+    }
+    pool_wait(pool, group);
+}
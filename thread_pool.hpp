@@ -0,0 +1,47 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+typedef std::function<void()> Task;
+
+// Counts the tasks submitted against it that haven't finished yet, so a caller can wait for just its own work.
+struct Task_Group {
+    std::atomic<size_t> pending = 0;
+};
+
+struct Queued_Task {
+    Task        run;
+    Task_Group* group;
+};
+
+struct Work_Queue {
+    std::mutex              lock;
+    std::deque<Queued_Task> tasks;
+};
+
+// A work-stealing pool: every worker pops from the back of its own queue and, once that's empty, steals from the
+// front of the others'. Threads waiting on a group run that group's tasks too, so tasks can submit and wait on more
+// tasks.
+struct Thread_Pool {
+    std::vector<std::thread>                 workers;
+    std::vector<std::unique_ptr<Work_Queue>> queues;
+    Work_Queue                               outside; // Tasks submitted by threads that aren't workers.
+    std::atomic<size_t>                      queued;  // Tasks sitting in a queue that nobody has picked up yet.
+    std::atomic<bool>                        stopping;
+    std::mutex                               sleep_lock;
+    std::condition_variable                  wake; // Idle workers, one per submitted task.
+    std::condition_variable                  done; // Threads in pool_wait, whenever a group finishes.
+};
+
+void pool_start(Thread_Pool& pool, size_t threads);
+void pool_submit(Thread_Pool& pool, Task_Group& group, Task task);
+void pool_wait(Thread_Pool& pool, Task_Group& group);
+void pool_stop(Thread_Pool& pool);
+void pool_parallel_for(Thread_Pool& pool, size_t count, const std::function<void(size_t)>& body);
@@ -0,0 +1,201 @@
+#include "trace.hpp"
+#include "compiler.hpp"
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+constexpr const char* COUNTER_NAMES[] = {
+    "tokens", "motion iterations", "segments recorded", "lines drawn", "pixels filled", "pixels blended",
+    "bytes encoded",
+};
+constexpr size_t COUNTER_COUNT = size(COUNTER_NAMES);
+static_assert(COUNTER_COUNT == (size_t)Trace_Counter::Bytes_Encoded + 1);
+
+#if LOGO_TRACE
+constexpr size_t TOKEN_TYPE_COUNT = (size_t)Token_Type::InvalidToken + 1;
+
+// Statements are counted by their command, the keyword they start with.
+constexpr pair<Token_Type, const char*> STATEMENT_NAMES[] = {
+    {Token_Type::PENUP, "PENUP"},
+    {Token_Type::PENDOWN, "PENDOWN"},
+    {Token_Type::FORWARD, "FORWARD"},
+    {Token_Type::BACK, "BACK"},
+    {Token_Type::LEFT, "LEFT"},
+    {Token_Type::RIGHT, "RIGHT"},
+    {Token_Type::SETPENCOLOR, "SETPENCOLOR"},
+    {Token_Type::SETPENSIZE, "SETPENSIZE"},
+    {Token_Type::TURN, "TURN"},
+    {Token_Type::SETHEADING, "SETHEADING"},
+    {Token_Type::SETX, "SETX"},
+    {Token_Type::SETY, "SETY"},
+    {Token_Type::FRAME, "FRAME"},
+    {Token_Type::MAKE, "MAKE"},
+    {Token_Type::ADDASSIGN, "ADDASSIGN"},
+    {Token_Type::IF, "IF"},
+    {Token_Type::WHILE, "WHILE"},
+    {Token_Type::Identifier, "procedure call"},
+};
+
+static const char* statement_name(size_t command) {
+    for (auto [type, name] : STATEMENT_NAMES) {
+        if ((size_t)type == command) return name;
+    }
+    return "other";
+}
+
+struct Trace_Event {
+    const char* name;
+    double      start; // Microseconds since the first event.
+    double      duration;
+};
+
+// Every thread records into its own buffers, so tracing never makes threads wait on each other.
+struct Trace_Thread {
+    uint32_t            id;
+    vector<Trace_Event> events;
+    uint64_t            counters[COUNTER_COUNT];
+    uint64_t            ops[OP_CODE_COUNT];
+    uint64_t            statements[TOKEN_TYPE_COUNT];
+};
+
+struct Trace_State {
+    mutex                            lock;
+    vector<unique_ptr<Trace_Thread>> threads;
+    chrono::steady_clock::time_point epoch = chrono::steady_clock::now();
+};
+
+// Never destroyed, so the trace can still be written from an atexit handler.
+static Trace_State& trace_state() {
+    static auto state = new Trace_State;
+    return *state;
+}
+
+static Trace_Thread& this_thread_trace() {
+    thread_local Trace_Thread* trace = nullptr;
+    if (!trace) {
+        auto& state = trace_state();
+        lock_guard guard(state.lock);
+        auto&      thread = state.threads.emplace_back(make_unique<Trace_Thread>());
+        thread->id        = state.threads.size();
+        trace             = thread.get();
+    }
+    return *trace;
+}
+
+static double now_us() {
+    return chrono::duration<double, micro>(chrono::steady_clock::now() - trace_state().epoch).count();
+}
+
+Trace_Scope::Trace_Scope(const char* name) : name(name), start(now_us()) {}
+
+Trace_Scope::~Trace_Scope() {
+    this_thread_trace().events.push_back({name, start, now_us() - start});
+}
+
+void trace_count(Trace_Counter counter, uint64_t amount) {
+    this_thread_trace().counters[(size_t)counter] += amount;
+}
+
+void trace_op(size_t op) {
+    this_thread_trace().ops[op]++;
+}
+
+void trace_statement(size_t command) {
+    if (command != (size_t)Token_Type::EndOfFile) this_thread_trace().statements[command]++;
+}
+
+// Chrome's trace event format, which chrome://tracing and Perfetto both open. Every scope is a complete ("X") event
+// on its thread's track, and the counter totals go in one counter ("C") event at the end.
+bool trace_write_chrome(const char* path) {
+    auto out = fopen(path, "w");
+    if (!out) return false;
+    auto&    state = trace_state();
+    double   end   = 0;
+    uint64_t counters[COUNTER_COUNT] = {};
+    fprintf(out, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    for (auto& thread : state.threads) {
+        fprintf(out, "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %u, "
+                     "\"args\": {\"name\": \"thread %u\"}},\n",
+                thread->id, thread->id);
+        for (auto& event : thread->events) {
+            fprintf(out, "{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f},\n",
+                    event.name, thread->id, event.start, event.duration);
+            end = max(end, event.start + event.duration);
+        }
+        for (size_t i = 0; i < COUNTER_COUNT; i++) counters[i] += thread->counters[i];
+    }
+    fprintf(out, "{\"name\": \"counters\", \"ph\": \"C\", \"pid\": 1, \"tid\": 1, \"ts\": %.3f, \"args\": {", end);
+    for (size_t i = 0; i < COUNTER_COUNT; i++) {
+        fprintf(out, "%s\"%s\": %llu", i ? ", " : "", COUNTER_NAMES[i], (unsigned long long)counters[i]);
+    }
+    fprintf(out, "}}\n]}\n");
+    return fclose(out) == 0;
+}
+
+// Everything that ran at least once, busiest first, with its share of the total.
+static void print_executed(FILE* out, const char* heading, const uint64_t* counts, size_t count,
+                           const char* (*name)(size_t)) {
+    vector<size_t> order;
+    uint64_t       executed = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (counts[i]) order.push_back(i);
+        executed += counts[i];
+    }
+    sort(order.begin(), order.end(), [&](size_t a, size_t b) { return counts[a] > counts[b]; });
+    fprintf(out, "\n%-24s %14s %8s\n", heading, "executed", "share");
+    for (auto i : order) {
+        fprintf(out, "%-24s %14llu %7.2f%%\n", name(i), (unsigned long long)counts[i], 100.0 * counts[i] / executed);
+    }
+}
+
+// Totals over every thread: time per scope name, the counters, and how often each kind of statement and each opcode
+// ran, busiest first.
+void trace_print_summary(FILE* out) {
+    struct Scope_Total {
+        size_t calls;
+        double total, max;
+    };
+    map<string_view, Scope_Total> scopes;
+    uint64_t                      counters[COUNTER_COUNT]      = {};
+    uint64_t                      ops[OP_CODE_COUNT]           = {};
+    uint64_t                      statements[TOKEN_TYPE_COUNT] = {};
+    for (auto& thread : trace_state().threads) {
+        for (auto& event : thread->events) {
+            auto& total = scopes[event.name];
+            total.calls++;
+            total.total += event.duration;
+            total.max = max(total.max, event.duration);
+        }
+        for (size_t i = 0; i < COUNTER_COUNT; i++) counters[i] += thread->counters[i];
+        for (size_t i = 0; i < OP_CODE_COUNT; i++) ops[i] += thread->ops[i];
+        for (size_t i = 0; i < TOKEN_TYPE_COUNT; i++) statements[i] += thread->statements[i];
+    }
+
+    fprintf(out, "%-24s %10s %12s %12s %12s\n", "scope", "calls", "total ms", "mean ms", "max ms");
+    for (auto& [name, total] : scopes) {
+        fprintf(out, "%-24.*s %10zu %12.3f %12.3f %12.3f\n", (int)name.size(), name.data(), total.calls,
+                total.total / 1000, total.total / 1000 / total.calls, total.max / 1000);
+    }
+    fprintf(out, "\n%-24s %14s\n", "counter", "total");
+    for (size_t i = 0; i < COUNTER_COUNT; i++) {
+        fprintf(out, "%-24s %14llu\n", COUNTER_NAMES[i], (unsigned long long)counters[i]);
+    }
+
+    print_executed(out, "statement", statements, TOKEN_TYPE_COUNT, statement_name);
+    print_executed(out, "opcode", ops, OP_CODE_COUNT, [](size_t op) { return op_code_name((Op_Code)op); });
+}
+#else
+bool trace_write_chrome(const char*) {
+    return false;
+}
+
+void trace_print_summary(FILE* out) {
+    fprintf(out, "Tracing isn't compiled into this build, rebuild with TRACE=1 ./build.sh.\n");
+}
+#endif
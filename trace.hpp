@@ -0,0 +1,59 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+// Instrumentation for finding out where a program's time goes: how long each phase took on every thread, how many of
+// each kind of statement and each opcode ran, and how much the rasterizer and encoder did. It's only compiled in when
+// LOGO_TRACE is 1 (build with TRACE=1 ./build.sh). Otherwise every TRACE_ macro expands to nothing, so it costs
+// nothing.
+#ifndef LOGO_TRACE
+#define LOGO_TRACE 0
+#endif
+
+constexpr bool TRACE_ENABLED = LOGO_TRACE;
+
+enum class Trace_Counter {
+    Tokens,
+    Motion_Iterations, // Loop iterations run by a Motion_Loop rather than the bytecode.
+    Segments_Recorded,
+    Lines_Drawn, // Once for every tile a line is drawn into.
+    Pixels_Filled,
+    Pixels_Blended,
+    Bytes_Encoded,
+};
+
+#if LOGO_TRACE
+// Records how long the enclosing block took, on the thread it ran on.
+struct Trace_Scope {
+    const char* name;
+    double      start;
+
+    explicit Trace_Scope(const char* name);
+    ~Trace_Scope();
+};
+
+void trace_count(Trace_Counter counter, uint64_t amount);
+void trace_op(size_t op);
+// Takes a statement's command token. Statements in a WHILE run in closed form aren't counted, Motion_Iterations has
+// those loops instead.
+void trace_statement(size_t command);
+
+#define TRACE_JOIN_(a, b) a##b
+#define TRACE_JOIN(a, b) TRACE_JOIN_(a, b)
+// `name` has to be a string literal, events only keep the pointer.
+#define TRACE_SCOPE(name) Trace_Scope TRACE_JOIN(trace_scope_, __LINE__)(name)
+#define TRACE_COUNT(counter, amount) trace_count(Trace_Counter::counter, amount)
+#define TRACE_OP(op) trace_op((size_t)(op))
+#define TRACE_STATEMENT(command) trace_statement((size_t)(command))
+#else
+#define TRACE_SCOPE(name) ((void)0)
+#define TRACE_COUNT(counter, amount) ((void)0)
+#define TRACE_OP(op) ((void)0)
+#define TRACE_STATEMENT(command) ((void)0)
+#endif
+
+// Both only make sense once every traced thread has finished. Without LOGO_TRACE there's nothing to write and
+// trace_write_chrome fails.
+bool trace_write_chrome(const char* path);
+void trace_print_summary(FILE* out);
@@ -1,9 +1,20 @@
 #pragma once
 #include "util.hpp"
+#include <chrono>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
 #include <filesystem>
 #include <fstream>
 #include <numbers>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 inline std::string read_file(const std::string& path) {
     std::ifstream f(path, std::ios::binary);
@@ -12,6 +23,85 @@ inline std::string read_file(const std::string& path) {
     return s;
 }
 
-inline float degree_to_radians(float degrees) {
+// A read-only view of a whole file, backed by the page cache instead of a copy on the heap.
+struct Mapped_File {
+    const char* data;
+    size_t      size;
+
+    std::string_view contents() const { return {data, size}; }
+};
+
+inline std::optional<Mapped_File> map_file(const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return std::nullopt;
+    struct stat info;
+    if (fstat(fd, &info) < 0) {
+        close(fd);
+        return std::nullopt;
+    }
+    // mmap refuses zero length mappings, and an empty file has nothing to map anyway.
+    Mapped_File file = {"", (size_t)info.st_size};
+    if (file.size > 0) {
+        void* data = mmap(nullptr, file.size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            close(fd);
+            return std::nullopt;
+        }
+        madvise(data, file.size, MADV_SEQUENTIAL);
+        file.data = (const char*)data;
+    }
+    close(fd);
+    return file;
+}
+
+inline void unmap_file(Mapped_File& file) {
+    if (file.size > 0) munmap((void*)file.data, file.size);
+    file = {"", 0};
+}
+
+inline double elapsed_ms(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+inline double degree_to_radians(double degrees) {
     return degrees * (std::numbers::pi / 180.0f);
-}
\ No newline at end of file
+}
+
+// Where errors about a program go on this thread. Batch jobs and the benchmark capture them for a while, so they can
+// be printed after their tables next to the program they came from.
+inline thread_local FILE* error_output = stderr;
+
+// Everything written to error_output on this thread between begin_error_capture and end_error_capture.
+struct Error_Capture {
+    FILE*  stream;
+    char*  text;
+    size_t size;
+};
+
+inline void begin_error_capture(Error_Capture& capture) {
+    capture        = {nullptr, nullptr, 0};
+    capture.stream = open_memstream(&capture.text, &capture.size);
+    if (capture.stream) error_output = capture.stream;
+}
+
+// Returns what was captured, without the last newline. If the capture couldn't be opened the errors went to stderr
+// as they happened instead.
+inline std::string end_error_capture(Error_Capture& capture) {
+    if (!capture.stream) return "";
+    error_output = stderr;
+    fclose(capture.stream);
+    std::string text(capture.text, capture.size);
+    free(capture.text);
+    while (!text.empty() && text.back() == '\n') text.pop_back();
+    return text;
+}
+
+// Prints an error message that points at the logo source line it came from.
+__attribute__((format(printf, 2, 3))) inline void report_error(uint32_t line, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    fprintf(error_output, "ERROR! (line %u) ", line);
+    vfprintf(error_output, format, args);
+    fputc('\n', error_output);
+    va_end(args);
+}